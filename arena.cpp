@@ -0,0 +1,5 @@
+// Memory reuse helpers (pool allocation counters)
+//-------------------------------------------------
+#include "arena.h"
+
+HeapCounters g_pool_heap{ 0u, 0u };
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef W2DIR_ARENA_H
+#define W2DIR_ARENA_H
+// Memory reuse helpers: counted component pools and the per-frame scratch arena
+//-------------------------------------------------------------------------------
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+#include "memory.h"
+
+// Running tally of heap trips made on behalf of pooled (ECS) storage
+struct HeapCounters {
+	size_t allocs;	// Number of calls that went to the heap
+	size_t bytes;	// Total bytes requested by those calls
+};
+extern HeapCounters g_pool_heap;
+
+// std-compatible allocator for pooled storage: defers to operator new, but counts every call.
+// Once a pool has been reserved to its level capacity, this should never fire again
+// (so any change in g_pool_heap during a steady-state frame is a bug).  The heap hooks charge
+// pool storage to MEM_ECS.
+template<typename T>
+struct PoolAllocator {
+	using value_type = T;
+
+	PoolAllocator() = default;
+	template<typename U> PoolAllocator(const PoolAllocator<U>&) {}
+
+	T *allocate(size_t n) {
+		MEMORY_TAG(MEM_ECS);
+		++g_pool_heap.allocs;
+		g_pool_heap.bytes += n * sizeof(T);
+		return static_cast<T *>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T *p, size_t) {
+		::operator delete(p);
+	}
+};
+
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+// Fixed-capacity (once reserved) storage for a column of ECS data
+template<typename T>
+using Pool = std::vector<T, PoolAllocator<T>>;
+
+// Bump allocator for per-frame temporaries: one block grabbed up front,
+// handed out in aligned slices, and released all at once by reset()
+class FrameArena {
+	std::unique_ptr<uint8_t[]> base_;
+	size_t capacity_;
+	size_t top_;			// Offset of the first free byte
+	size_t high_water_;		// Largest top_ ever seen (for sizing the arena)
+public:
+	explicit FrameArena(size_t capacity) :
+		base_{ new uint8_t[capacity] }, capacity_{ capacity }, top_{ 0u }, high_water_{ 0u } {}
+
+	// No copy/move/assign (outstanding slices point into our block)
+	FrameArena(const FrameArena& other) = delete;
+	FrameArena& operator=(const FrameArena& other) = delete;
+
+	// Grab <size> bytes aligned to <align> (a power of 2); throws std::bad_alloc when the block is exhausted
+	void *alloc(size_t size, size_t align = alignof(std::max_align_t)) {
+		size_t start = (top_ + align - 1) & ~(align - 1);
+		if (start + size > capacity_) { throw std::bad_alloc(); }
+		top_ = start + size;
+		if (top_ > high_water_) { high_water_ = top_; }
+		return base_.get() + start;
+	}
+
+	// Typed convenience wrapper (no constructors/destructors are run, so keep it to POD-ish types)
+	template<typename T>
+	T *alloc_array(size_t count) {
+		static_assert(std::is_trivially_destructible<T>::value, "FrameArena never runs destructors");
+		return static_cast<T *>(alloc(count * sizeof(T), alignof(T)));
+	}
+
+	// Release everything handed out since the last reset (O(1))
+	void reset() { top_ = 0u; }
+
+	size_t used() const { return top_; }
+	size_t capacity() const { return capacity_; }
+	size_t high_water() const { return high_water_; }
+};
+
+#endif
@@ -1,6 +1,10 @@
 // Resource loading/handling logic for the built-in WetSpot 2 assets (sprites, sounds, palettes, etc.)
 //----------------------------------------------------------------------------------------------------
+#include <algorithm>
+
 #include "assets.h"
+#include "memory.h"
+#include "trace.h"
 
 // Utility function to open and read the entire [binary] contents
 // of a given file into a vector<char> (resizing as necessary)
@@ -25,7 +29,7 @@ bool slurp_file(const char *filename, Buffer& dest) {
 
 // Like slurp_file, but specifically for loading QuickBASIC
 // VGA mode 13h BSAVEd image files.
-static bool bload_file(const char *filename, Buffer& dest) {
+bool bload_file(const char *filename, Buffer& dest) {
 	awful::FilePtr fp{ al_fopen(filename, "rb") };
 	if (!fp) { return false; }
 
@@ -68,15 +72,14 @@ awful::BitmapPtr bload_convert(const Buffer& data, const Palette& pal) {
 }
 
 awful::BitmapPtr bload_image(const char *file_name, const Palette& pal) {
+	TRACE_SCOPE("bload_image");
+	MEMORY_TAG(MEM_ASSETS);
 	Buffer temp;
 	if (!bload_file(file_name, temp)) { throw std::exception("Unable to load BSAVED data from disk"); }
 	return bload_convert(temp, pal);
 }
 
 
-// Frequency in Hertz (samples per second) for PCM WAV data
-static constexpr int FREQUENCY{ 11025 };
-
 // Locations/sizes of 8-bit PCM (11.025 KHz) audio samples in Wetspot2's RESOURCE.BIN file
 static const struct sample_loc_t {
 	size_t offset;
@@ -121,17 +124,26 @@ FONT_GRID_COLS{ 16 },						// Columns in font grid bitmap (arbitrary)
 FONT_GRID_ROWS{ FONT_NUM_GLYPHS / FONT_GRID_COLS };
 
 ResourceBin::ResourceBin(const char *pathToResourceBin) {
-	if (!slurp_file(pathToResourceBin, data_)) {
-		throw std::exception("Unable to load RESOURCE.BIN data");
+	TRACE_SCOPE("ResourceBin");
+	MEMORY_TAG(MEM_ASSETS);
+	{
+		TRACE_SCOPE("read RESOURCE.BIN");
+		if (!slurp_file(pathToResourceBin, data_)) {
+			throw std::exception("Unable to load RESOURCE.BIN data");
+		}
 	}
 
 	// Create ALLEGRO_SAMPLE objects for each raw sample contained in our data
-	for (size_t i = 0; i < NUM_SOUNDS; ++i) {
-		void *sample_start = &data_[samples[i].offset];
-		wavs_.emplace_back(al_create_sample(sample_start, samples[i].length, FREQUENCY, ALLEGRO_AUDIO_DEPTH_UINT8, ALLEGRO_CHANNEL_CONF_1, false));
+	{
+		TRACE_SCOPE("create samples");
+		for (size_t i = 0; i < NUM_SOUNDS; ++i) {
+			void *sample_start = &data_[samples[i].offset];
+			wavs_.emplace_back(al_create_sample(sample_start, samples[i].length, SOUND_FREQUENCY, ALLEGRO_AUDIO_DEPTH_UINT8, ALLEGRO_CHANNEL_CONF_1, false));
+		}
 	}
 
 	// Create default palette colors
+	TRACE_SCOPE("decode palettes");
 	size_t offset = DEFAULT_PAL_OFFSET;
 	for (size_t i = 0; i < VGA13_COLORS; ++i) {
 		const uint8_t *cp = &data_[offset];
@@ -179,16 +191,32 @@ ResourceBin::ResourceBin(const char *pathToResourceBin) {
 	}
 }
 
+ResourceBin::raw_sound_t ResourceBin::raw_sound(size_t index) const {
+	const sample_loc_t& loc = samples[index];
+	return raw_sound_t{ &data_[loc.offset], loc.length };
+}
+
+const uint8_t *ResourceBin::font_glyph(unsigned char ch) const {
+	if ((ch < FONT_ASCII_START) || (ch >= FONT_ASCII_END)) { return nullptr; }
+	return &data_[FONT_DATA_OFFSET + ((ch - FONT_ASCII_START) * FONT_GLYPH_SIZE)];
+}
+
 SpritesBin::SpritesBin(
 	const ResourceBin& rsrc,
 	const char *pathToSpritesBin)
 {
+	TRACE_SCOPE("SpritesBin");
+	MEMORY_TAG(MEM_ASSETS);
 	Buffer raw;
-	if (!bload_file(pathToSpritesBin, raw)) {
-		throw std::exception("Unable to read data from SPRITES.BIN");
+	{
+		TRACE_SCOPE("read SPRITES.BIN");
+		if (!bload_file(pathToSpritesBin, raw)) {
+			throw std::exception("Unable to read data from SPRITES.BIN");
+		}
 	}
 
 	for (size_t i = 0; i < sprite_maps_.size(); ++i) {
+		TRACE_SCOPE("convert sprite sheet");
 		sprite_maps_[i] = bload_convert(raw, rsrc.game_palette(i));
 
 		for (size_t n = 0; n < NUM_SPRITES; ++n) {
@@ -201,4 +229,53 @@ SpritesBin::SpritesBin(
 			sprites_[i][n].reset(sprite);
 		}
 	}
+
+	// Keep the palette indices too (for the indexed software renderer)
+	indexed_ = std::move(raw);
+}
+
+size_t SpritesBin::bitmap_bytes() const {
+	size_t bytes = 0u;
+	for (const auto& sheet : sprite_maps_) {
+		ALLEGRO_BITMAP *bmp = sheet.get();
+		bytes += size_t(al_get_bitmap_width(bmp)) * al_get_bitmap_height(bmp) * al_get_pixel_size(al_get_bitmap_format(bmp));
+	}
+	return bytes;
+}
+
+ImageBank::ImageBank(const SpritesBin& sprites) {
+	images_.reserve((ResourceBin::PAL_COUNT * NUM_SPRITES) + 16);
+	atlases_.reserve(images_.capacity());
+	widths_.reserve(images_.capacity());
+	heights_.reserve(images_.capacity());
+	for (size_t p = 0; p < ResourceBin::PAL_COUNT; ++p) {
+		for (size_t n = 0; n < NUM_SPRITES; ++n) {
+			add_internal(sprites.sprite(n, static_cast<ResourceBin::PALETTE>(p)));
+		}
+	}
+}
+
+image_id_t ImageBank::add(ALLEGRO_BITMAP *bitmap) {
+	if (images_.size() >= NO_IMAGE) {
+		throw std::exception("ImageBank is full");
+	}
+	add_internal(bitmap);
+	return static_cast<image_id_t>(images_.size() - 1);
+}
+
+void ImageBank::add_internal(ALLEGRO_BITMAP *bitmap) {
+	// Sub-bitmaps share their parent's atlas; anything else is an atlas of its own
+	ALLEGRO_BITMAP *parent = al_get_parent_bitmap(bitmap);
+	if (!parent) { parent = bitmap; }
+
+	auto found = std::find(parents_.begin(), parents_.end(), parent);
+	if (found == parents_.end()) {
+		if (parents_.size() > UINT8_MAX) { throw std::exception("ImageBank has too many atlases"); }
+		found = parents_.insert(parents_.end(), parent);
+	}
+
+	images_.push_back(bitmap);
+	atlases_.push_back(static_cast<uint8_t>(found - parents_.begin()));
+	widths_.push_back(float(al_get_bitmap_width(bitmap)));
+	heights_.push_back(float(al_get_bitmap_height(bitmap)));
 }
\ No newline at end of file
@@ -10,9 +10,15 @@
 // of a given file into a vector<char> (resizing as necessary)
 bool slurp_file(const char *filename, Buffer& dest);
 
+// Read the raw (palette index) pixel data of a BSAVEd VGA mode 13h image
+bool bload_file(const char *filename, Buffer& dest);
+
 // Convenience function to BLOAD an image file with a given palette
 awful::BitmapPtr bload_image(const char *file_name, const Palette& pal);
 
+// All sound effects are 8-bit unsigned mono PCM at this rate
+constexpr unsigned SOUND_FREQUENCY = 11025;
+
 // Principle asset collection used in the game, containing:
 // - the font
 // - all the palettes
@@ -44,6 +50,19 @@ public:
 	}
 	size_t num_sounds() const { return wavs_.size(); }
 
+	// Raw PCM of a sound effect (for our own mixer; <length> is in samples == bytes)
+	struct raw_sound_t {
+		const uint8_t	*data;
+		size_t			length;
+	};
+	raw_sound_t raw_sound(size_t index) const;
+
+	// 8x8 1-bit glyph (8 rows, most significant bit leftmost) for a character, or nullptr if the font lacks it
+	const uint8_t *font_glyph(unsigned char ch) const;
+
+	// Size of the raw file data (the samples point into it)
+	size_t data_bytes() const { return data_.capacity(); }
+
 private:
 	// Raw backing store (entire file read into memory)
 	Buffer data_;
@@ -72,6 +91,9 @@ class SpritesBin {
 
 	// Sub-bitmaps for each sprite (for each palette)
 	std::array<std::array<awful::BitmapPtr, NUM_SPRITES>, ResourceBin::PAL_COUNT> sprites_;
+
+	// The original palette-index data (SPRITES_COLS * SPRITE_WIDTH pixels per row)
+	Buffer indexed_;
 public:
 	// Must have loaded palette data from RESOURCE.BIN first!
 	SpritesBin(const ResourceBin& rsrc, const char *pathToSpritesBin = "SPRITES.BIN");
@@ -85,6 +107,51 @@ public:
 	ALLEGRO_BITMAP *sprite(size_t shape, ResourceBin::PALETTE palette = ResourceBin::PAL_DEFAULT) const {
 		return sprites_.at(palette).at(shape).get();
 	}
+
+	// Get the whole grid as raw palette indices (may be shorter than a full grid)
+	const Buffer& indexed() const { return indexed_; }
+
+	// Pixel storage of the sprite sheet bitmaps (Allegro's, so never seen by the heap hooks;
+	// the sub-bitmaps share it)
+	size_t bitmap_bytes() const;
+};
+
+// Position-independent handle for a drawable bitmap (an index into an ImageBank)
+using image_id_t = uint16_t;
+constexpr image_id_t NO_IMAGE = 0xFFFFu;
+
+// Table of every bitmap components may refer to, so that components can hold plain integer
+// handles instead of pointers. IDs [0, PAL_COUNT * NUM_SPRITES) are always the SpritesBin
+// sprites (palette-major); other bitmaps (backgrounds, etc.) are appended after those.
+class ImageBank {
+	std::vector<ALLEGRO_BITMAP *> images_;	// Non-owning
+	std::vector<uint8_t> atlases_;			// Parallel to images_: which texture atlas (parent bitmap) each lives in
+	std::vector<ALLEGRO_BITMAP *> parents_;	// Atlas number -> parent bitmap
+	std::vector<float> widths_, heights_;	// Parallel to images_ (cached so bounds never touch Allegro)
+
+	void add_internal(ALLEGRO_BITMAP *bitmap);
+public:
+	explicit ImageBank(const SpritesBin& sprites);
+
+	// Handle for a given sprite shape in a given palette (no table lookup needed)
+	static image_id_t sprite_id(size_t shape, ResourceBin::PALETTE palette = ResourceBin::PAL_DEFAULT) {
+		return static_cast<image_id_t>((palette * NUM_SPRITES) + shape);
+	}
+
+	// Register some other bitmap (which must outlive the bank) and get its handle
+	image_id_t add(ALLEGRO_BITMAP *bitmap);
+
+	ALLEGRO_BITMAP *bitmap(image_id_t id) const {
+		return (id == NO_IMAGE) ? nullptr : images_.at(id);
+	}
+
+	// Small dense number identifying the atlas (parent bitmap) an image is drawn from;
+	// draws sharing an atlas can be batched together
+	uint8_t atlas(image_id_t id) const { return atlases_[id]; }
+
+	float width(image_id_t id) const { return widths_[id]; }
+	float height(image_id_t id) const { return heights_[id]; }
+	size_t num_atlases() const { return parents_.size(); }
 };
 
 #endif
\ No newline at end of file
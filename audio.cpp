@@ -0,0 +1,436 @@
+// Software sound effect mixer
+//-----------------------------
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define W2DIR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "audio.h"
+#include "memory.h"
+#include "trace.h"
+
+// Convert unsigned 8-bit PCM to float in [-1, 1)
+static void convert_u8(float *dst, const uint8_t *src, size_t count) {
+	const float scale = 1.0f / 128.0f;
+	size_t i = 0;
+#if W2DIR_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 bias = _mm_set1_ps(128.0f), mul = _mm_set1_ps(scale);
+	for (; i + 16 <= count; i += 16) {
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		__m128i lo = _mm_unpacklo_epi8(s, zero), hi = _mm_unpackhi_epi8(s, zero);
+		__m128i words[4] = { _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+			_mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero) };
+		for (int k = 0; k < 4; ++k) {
+			_mm_storeu_ps(dst + i + (k * 4), _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(words[k]), bias), mul));
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		dst[i] = (float(src[i]) - 128.0f) * scale;
+	}
+}
+
+// out[2i] += mono[i] * gain_l, out[2i + 1] += mono[i] * gain_r
+static void accumulate_stereo(float *out, const float *mono, size_t count, float gain_l, float gain_r) {
+	size_t i = 0;
+#if W2DIR_SSE2
+	const __m128 gains = _mm_set_ps(gain_r, gain_l, gain_r, gain_l);
+	for (; i + 4 <= count; i += 4) {
+		__m128 m = _mm_loadu_ps(mono + i);
+		float *o = out + (i * 2);
+		_mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), _mm_mul_ps(_mm_unpacklo_ps(m, m), gains)));
+		_mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_mul_ps(_mm_unpackhi_ps(m, m), gains)));
+	}
+#endif
+	for (; i < count; ++i) {
+		out[i * 2] += mono[i] * gain_l;
+		out[(i * 2) + 1] += mono[i] * gain_r;
+	}
+}
+
+static void clamp_samples(float *out, size_t count) {
+	size_t i = 0;
+#if W2DIR_SSE2
+	const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(out + i), lo), hi));
+	}
+#endif
+	for (; i < count; ++i) {
+		out[i] = std::min(std::max(out[i], -1.0f), 1.0f);
+	}
+}
+
+Mixer::Mixer(const ResourceBin& rsrc, size_t voices, unsigned rate, size_t max_frames) :
+	voices_(voices, voice_t{ nullptr, 0u, 0u, 0.0f, 0.0f, 0, 0u, NO_SOUND, false }), mono_(max_frames),
+	max_frames_{ max_frames }, step_{ static_cast<uint32_t>((uint64_t(SOUND_FREQUENCY) << 16) / rate) },
+	serial_{ 0u }, played_{ 0u }, stolen_{ 0u }, rejected_{ 0u }
+{
+	if (!voices || !max_frames || !step_) { throw std::exception("Invalid Mixer configuration"); }
+
+	for (size_t i = 0; i < rsrc.num_sounds(); ++i) {
+		ResourceBin::raw_sound_t sound = rsrc.raw_sound(i);
+		if (sound.length >= 0x10000u) { throw std::exception("Sound effect too long for the mixer"); }
+		sounds_.push_back(sound);
+	}
+
+	// Source samples touched by one mix(), plus the interpolation neighbor
+	src_.resize(((uint64_t(max_frames) * step_) >> 16) + 3);
+}
+
+int Mixer::play(size_t index, float gain, float pan, int priority) {
+	if ((index >= sounds_.size()) || !sounds_[index].length) { return NO_VOICE; }
+
+	// A free voice, or else the oldest of the lowest-priority voices that isn't above us
+	int pick = NO_VOICE;
+	for (size_t i = 0; i < voices_.size(); ++i) {
+		const voice_t& v = voices_[i];
+		if (!v.active) {
+			pick = int(i);
+			break;
+		}
+		if (v.priority > priority) { continue; }
+		if (pick == NO_VOICE) {
+			pick = int(i);
+			continue;
+		}
+		const voice_t& best = voices_[pick];
+		if ((v.priority < best.priority) || ((v.priority == best.priority) && (int32_t(v.serial - best.serial) < 0))) {
+			pick = int(i);
+		}
+	}
+	if (pick == NO_VOICE) {
+		++rejected_;
+		return NO_VOICE;
+	}
+	if (voices_[pick].active) { ++stolen_; }
+
+	voice_t& v = voices_[pick];
+	v.data = sounds_[index].data;
+	v.length = static_cast<uint32_t>(sounds_[index].length);
+	v.pos = 0u;
+	v.priority = priority;
+	v.serial = serial_++;
+	v.sound = sound_id_t(index);
+	v.active = true;
+	set_gain(pick, gain, pan);
+	++played_;
+	return pick;
+}
+
+bool Mixer::playing(int voice, size_t index) const {
+	if ((voice < 0) || (size_t(voice) >= voices_.size())) { return false; }
+	const voice_t& v = voices_[voice];
+	return v.active && (v.sound == sound_id_t(index));
+}
+
+void Mixer::set_gain(int voice, float gain, float pan) {
+	// Constant power pan
+	const float angle = (std::min(std::max(pan, -1.0f), 1.0f) + 1.0f) * 0.785398163f;
+	voice_t& v = voices_.at(voice);
+	v.gain_l = gain * std::cos(angle);
+	v.gain_r = gain * std::sin(angle);
+}
+
+void Mixer::set_sound_gain(size_t index, float gain, float pan) {
+	for (size_t i = 0; i < voices_.size(); ++i) {
+		if (playing(int(i), index)) { set_gain(int(i), gain, pan); }
+	}
+}
+
+void Mixer::stop(size_t index) {
+	for (auto& v : voices_) {
+		if (v.sound == sound_id_t(index)) { v.active = false; }
+	}
+}
+
+void Mixer::stop_all() {
+	for (auto& v : voices_) { v.active = false; }
+}
+
+size_t Mixer::active() const {
+	return static_cast<size_t>(std::count_if(voices_.begin(), voices_.end(), [](const voice_t& v) { return v.active; }));
+}
+
+size_t Mixer::active(size_t index) const {
+	return static_cast<size_t>(std::count_if(voices_.begin(), voices_.end(),
+		[index](const voice_t& v) { return v.active && (v.sound == sound_id_t(index)); }));
+}
+
+void Mixer::mix(float *out, size_t frames) {
+	frames = std::min(frames, max_frames_);
+	if (!frames) { return; }
+	std::fill_n(out, frames * 2, 0.0f);
+
+	for (auto& v : voices_) {
+		if (!v.active) { continue; }
+
+		// Output frames left in this voice (its position stays below <end>)
+		const uint32_t end = v.length << 16;
+		const size_t n = std::min(frames, size_t((end - v.pos + step_ - 1) / step_));
+
+		// Convert just the source samples those frames read, with the last one repeated
+		// so the interpolation never needs a bounds check
+		const uint32_t first = v.pos >> 16;
+		const uint32_t last = std::min((v.pos + uint32_t(n - 1) * step_) >> 16, v.length - 1);
+		const size_t count = last - first + 1;
+		convert_u8(src_.data(), v.data + first, count);
+		src_[count] = src_[count - 1];
+
+		// Linear resample (16.16 fixed point, so every voice advances identically)
+		uint32_t p = v.pos - (first << 16);
+		for (size_t i = 0; i < n; ++i, p += step_) {
+			const float *s = &src_[p >> 16];
+			const float frac = float(p & 0xFFFFu) * (1.0f / 65536.0f);
+			mono_[i] = s[0] + ((s[1] - s[0]) * frac);
+		}
+		accumulate_stereo(out, mono_.data(), n, v.gain_l, v.gain_r);
+
+		v.pos += uint32_t(n) * step_;
+		if (v.pos >= end) { v.active = false; }
+	}
+
+	clamp_samples(out, frames * 2);
+}
+
+constexpr sound_rule_t SoundCoalescer::DEFAULT_RULE;
+
+SoundCoalescer::SoundCoalescer(size_t sounds, const sound_rule_t& rule) :
+	rules_(sounds, rule), pending_(sounds, pending_t{ 0.0f, 0.0f, 0u }),
+	voices_(sounds, voice_state_t{ Mixer::NO_VOICE, 0u, 0.0f, 0.0f }), merged_{ 0u }, capped_{ 0u }
+{
+	triggers_.reserve(sounds);
+}
+
+const std::vector<sound_trigger_t>& SoundCoalescer::collect(SoundChannel& channel, tick_t tick) {
+	triggers_.clear();
+	for (const sound_event_t& e : channel) {
+		if ((e.sound < 0) || (size_t(e.sound) >= pending_.size())) { continue; }
+		pending_t& p = pending_[e.sound];
+		if (!p.count++) { triggers_.push_back(sound_trigger_t{ e.sound, 0u, 0.0f, 0.0f, tick }); }
+		p.gain += e.gain;
+		p.pan += e.pan * e.gain;
+	}
+	channel.clear();
+
+	for (sound_trigger_t& t : triggers_) {
+		pending_t& p = pending_[t.sound];
+		t.count = p.count;
+		t.gain = std::min(p.gain, rules_[t.sound].max_gain);
+		t.pan = (p.gain > 0.0f) ? (p.pan / p.gain) : 0.0f;
+		p = pending_t{ 0.0f, 0.0f, 0u };
+	}
+	return triggers_;
+}
+
+void SoundCoalescer::apply(const sound_trigger_t& t, Mixer& mixer) {
+	if ((t.sound < 0) || (size_t(t.sound) >= voices_.size())) { return; }
+	voice_state_t& s = voices_[t.sound];
+	const sound_rule_t& rule = rules_[t.sound];
+
+	if (((t.tick - s.started) < rule.window) && mixer.playing(s.voice, t.sound)) {
+		// Fold into the voice already playing
+		const float total = s.gain + t.gain;
+		s.pan = (total > 0.0f) ? (((s.pan * s.gain) + (t.pan * t.gain)) / total) : 0.0f;
+		s.gain = std::min(total, rule.max_gain);
+		mixer.set_gain(s.voice, s.gain, s.pan);
+		merged_ += t.count;
+	}
+	else if (mixer.active(t.sound) >= rule.max_voices) {
+		capped_ += t.count;
+	}
+	else {
+		s.voice = mixer.play(t.sound, t.gain, t.pan, rule.priority);
+		s.started = t.tick;
+		s.gain = t.gain;
+		s.pan = t.pan;
+		merged_ += t.count - 1;
+	}
+}
+
+void SoundCoalescer::drain(SoundChannel& channel, Mixer& mixer, tick_t tick) {
+	for (const sound_trigger_t& t : collect(channel, tick)) {
+		apply(t, mixer);
+	}
+}
+
+AudioStreamOutput::AudioStreamOutput(unsigned rate, size_t frames, size_t fragments) :
+	stream_{ al_create_audio_stream(fragments, static_cast<unsigned>(frames), rate, ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2) },
+	frames_{ frames }
+{
+	if (!stream_) { throw std::exception("Unable to create ALLEGRO_AUDIO_STREAM"); }
+	if (!al_get_default_mixer() && !al_restore_default_mixer()) { throw std::exception("Unable to create the default mixer"); }
+	if (!al_attach_audio_stream_to_mixer(stream_.get(), al_get_default_mixer())) {
+		throw std::exception("Unable to attach the audio stream to the mixer");
+	}
+	al_set_audio_stream_playing(stream_.get(), true);
+}
+
+ALLEGRO_EVENT_SOURCE *AudioStreamOutput::event_source() const {
+	return al_get_audio_stream_event_source(stream_.get());
+}
+
+bool AudioStreamOutput::starved() const {
+	return al_get_available_audio_stream_fragments(stream_.get()) == al_get_audio_stream_fragments(stream_.get());
+}
+
+size_t AudioStreamOutput::pump(Mixer& mixer) {
+	size_t filled = 0;
+	while (void *fragment = al_get_audio_stream_fragment(stream_.get())) {
+		float *out = static_cast<float *>(fragment);
+		for (size_t done = 0; done < frames_; done += mixer.max_frames()) {
+			mixer.mix(out + (done * 2), std::min(frames_ - done, mixer.max_frames()));
+		}
+		al_set_audio_stream_fragment(stream_.get(), fragment);
+		++filled;
+	}
+	return filled;
+}
+
+// Little-endian field writers for the WAV header
+static void put_u16(std::ofstream& out, uint16_t v) {
+	const char b[2] = { char(v & 0xFFu), char(v >> 8) };
+	out.write(b, sizeof(b));
+}
+
+static void put_u32(std::ofstream& out, uint32_t v) {
+	put_u16(out, uint16_t(v & 0xFFFFu));
+	put_u16(out, uint16_t(v >> 16));
+}
+
+WavRenderer::WavRenderer(const char *path, Mixer& mixer, SoundCoalescer& coalescer, unsigned tick_hz, unsigned rate) :
+	mixer_{ mixer }, coalescer_{ coalescer }, out_{ path, std::ios::binary }, rate_{ rate }, tick_hz_{ tick_hz },
+	frames_{ 0u }, mix_(mixer.max_frames() * 2), pcm_(mixer.max_frames() * 2 * sizeof(int16_t)), mix_seconds_{ 0.0 }
+{
+	if (!out_) { throw std::exception("Unable to open WAV file"); }
+	if (!tick_hz_) { throw std::exception("Invalid WavRenderer tick rate"); }
+	write_header();
+}
+
+WavRenderer::~WavRenderer() {
+	// Rewrite the header now that the sizes are known
+	out_.seekp(0);
+	write_header();
+}
+
+void WavRenderer::write_header() {
+	const uint32_t data_bytes = static_cast<uint32_t>(frames_ * 2 * sizeof(int16_t));
+	out_.write("RIFF", 4);
+	put_u32(out_, 36u + data_bytes);
+	out_.write("WAVEfmt ", 8);
+	put_u32(out_, 16u);						// PCM format chunk
+	put_u16(out_, 1u);						// ...integer samples
+	put_u16(out_, 2u);						// Stereo
+	put_u32(out_, rate_);
+	put_u32(out_, rate_ * 2u * sizeof(int16_t));
+	put_u16(out_, 2u * sizeof(int16_t));
+	put_u16(out_, 16u);
+	out_.write("data", 4);
+	put_u32(out_, data_bytes);
+}
+
+void WavRenderer::tick(SoundChannel& channel, tick_t tick) {
+	coalescer_.drain(channel, mixer_, tick);
+
+	const uint64_t end = (uint64_t(tick + 1) * rate_) / tick_hz_;
+	while (frames_ < end) {
+		const size_t count = static_cast<size_t>(std::min<uint64_t>(end - frames_, mixer_.max_frames()));
+
+		auto start = std::chrono::steady_clock::now();
+		mixer_.mix(mix_.data(), count);
+		mix_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		// 16-bit little-endian PCM
+		for (size_t i = 0; i < count * 2; ++i) {
+			uint16_t s = uint16_t(static_cast<int16_t>(std::floor((mix_[i] * 32767.0f) + 0.5f)));
+			pcm_[i * 2] = uint8_t(s & 0xFFu);
+			pcm_[(i * 2) + 1] = uint8_t(s >> 8);
+		}
+		out_.write(reinterpret_cast<const char *>(pcm_.data()), count * 2 * sizeof(int16_t));
+		frames_ += count;
+	}
+}
+
+AudioThread::AudioThread(Mixer& mixer, SoundCoalescer& coalescer, size_t depth) :
+	mixer_{ mixer }, coalescer_{ coalescer }, events_{ al_create_event_queue() },
+	commands_{ depth }, stop_{ false }, max_depth_{ 0u }, sent_{ 0u }, dropped_{ 0u },
+	fragments_{ 0u }, underruns_{ 0u }
+{
+	if (!events_) { throw std::exception("Unable to create audio event queue"); }
+	al_register_event_source(events_.get(), output_.event_source());
+	thread_ = std::thread{ &AudioThread::run, this };
+}
+
+AudioThread::~AudioThread() {
+	stop_.store(true);
+	thread_.join();
+}
+
+bool AudioThread::send(const command_t& cmd) {
+	++sent_;
+	command_t *slot = commands_.acquire();
+	if (!slot) {
+		++dropped_;
+		return false;
+	}
+	*slot = cmd;
+	commands_.publish();
+	max_depth_ = std::max(max_depth_, commands_.size());
+	return true;
+}
+
+void AudioThread::submit(SoundChannel& channel, tick_t tick) {
+	for (const sound_trigger_t& t : coalescer_.collect(channel, tick)) {
+		send(command_t{ command_t::TRIGGER, t });
+	}
+}
+
+bool AudioThread::set_gain(sound_id_t sound, float gain, float pan) {
+	return send(command_t{ command_t::SET_GAIN, sound_trigger_t{ sound, 0u, gain, pan, 0u } });
+}
+
+bool AudioThread::stop(sound_id_t sound) {
+	return send(command_t{ command_t::STOP, sound_trigger_t{ sound, 0u, 0.0f, 0.0f, 0u } });
+}
+
+void AudioThread::run() {
+	Trace::thread_name("audio");
+	MemoryTag::set(MEM_AUDIO);
+	bool primed = false;
+	while (!stop_.load()) {
+		// Wake up for every fragment the stream finishes (or every few ms to check for commands)
+		ALLEGRO_EVENT evt;
+		al_wait_for_event_timed(events_.get(), &evt, 0.005f);
+		while (al_get_next_event(events_.get(), &evt)) {}
+
+		while (command_t *cmd = commands_.peek()) {
+			const sound_trigger_t& t = cmd->trigger;
+			switch (cmd->op) {
+			case command_t::TRIGGER:
+				coalescer_.apply(t, mixer_);
+				break;
+			case command_t::SET_GAIN:
+				if (t.sound >= 0) { mixer_.set_sound_gain(t.sound, t.gain, t.pan); }
+				break;
+			case command_t::STOP:
+				if (t.sound >= 0) { mixer_.stop(t.sound); }
+				else { mixer_.stop_all(); }
+				break;
+			}
+			commands_.release();
+		}
+
+		if (primed && output_.starved()) { underruns_.fetch_add(1u); }
+		TRACE_SCOPE("mix");
+		if (size_t filled = output_.pump(mixer_)) {
+			fragments_.fetch_add(static_cast<unsigned long>(filled));
+			primed = true;
+		}
+	}
+}
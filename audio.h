@@ -0,0 +1,237 @@
+#pragma once
+#ifndef W2DIR_AUDIO_H
+#define W2DIR_AUDIO_H
+// Software sound effect mixer
+//-----------------------------
+
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_audio.h>
+
+#include "awful.h"
+#include "common.h"
+#include "assets.h"
+#include "sounds.h"
+#include "spsc.h"
+
+// Output format of the mixer: interleaved stereo float at this rate
+constexpr unsigned MIX_RATE = 44100;
+constexpr size_t MIX_VOICES = 32;
+constexpr size_t MIX_FRAGMENT_FRAMES = 512;		// ~11.6ms at MIX_RATE
+
+// Mixes the RESOURCE.BIN sound effects (8-bit unsigned mono, SOUND_FREQUENCY) into a stereo
+// float stream.  There's a fixed pool of voices, so the cost of mix() is bounded by the pool
+// size no matter how many sounds get triggered: when every voice is busy, play() steals the
+// oldest voice of the lowest priority (no higher than the new sound's), or rejects the sound.
+//
+// mix() doesn't touch Allegro, so it can be driven by an audio stream (AudioStreamOutput) or
+// by anything else that wants samples.
+class Mixer {
+public:
+	static constexpr int NO_VOICE = -1;
+private:
+	struct voice_t {
+		const uint8_t	*data;
+		uint32_t		length;			// In source samples
+		uint32_t		pos;			// 16.16 fixed point source position
+		float			gain_l, gain_r;
+		int				priority;
+		uint32_t		serial;			// Start order (lower is older)
+		sound_id_t		sound;
+		bool			active;
+	};
+
+	std::vector<ResourceBin::raw_sound_t>	sounds_;
+	std::vector<voice_t>	voices_;
+	std::vector<float>		src_, mono_;	// Per-voice scratch (converted source, resampled)
+	size_t					max_frames_;
+	uint32_t				step_;			// 16.16 source samples per output frame
+	uint32_t				serial_;
+	unsigned long			played_, stolen_, rejected_;
+public:
+	Mixer(const ResourceBin& rsrc, size_t voices = MIX_VOICES, unsigned rate = MIX_RATE,
+		size_t max_frames = MIX_FRAGMENT_FRAMES);
+
+	// Start sound <index> at <gain> (1.0 is unchanged), panned from -1.0 (left) to 1.0 (right);
+	// returns the voice, or NO_VOICE if rejected
+	int play(size_t index, float gain = 1.0f, float pan = 0.0f, int priority = 0);
+
+	// Is <voice> still playing sound <index>?
+	bool playing(int voice, size_t index) const;
+
+	// Change the gain/pan of a playing voice
+	void set_gain(int voice, float gain, float pan);
+
+	// ...or of every voice playing sound <index>
+	void set_sound_gain(size_t index, float gain, float pan);
+
+	void stop(size_t index);
+	void stop_all();
+
+	// Overwrite <out> with <frames> (at most max_frames()) stereo frames, clamped to [-1, 1]
+	void mix(float *out, size_t frames);
+
+	size_t max_frames() const { return max_frames_; }
+	size_t voices() const { return voices_.size(); }
+	size_t active() const;
+	size_t active(size_t index) const;		// Voices playing sound <index>
+	unsigned long played() const { return played_; }
+	unsigned long stolen() const { return stolen_; }
+	unsigned long rejected() const { return rejected_; }
+};
+
+// How SoundCoalescer treats triggers of one sound
+struct sound_rule_t {
+	tick_t		window;			// Triggers within this many ticks of the voice's start join that voice
+	unsigned	max_voices;		// Never more than this many voices of the sound at once
+	float		max_gain;		// Merged gain limit
+	int			priority;		// Mixer voice priority
+};
+
+// All of one tick's triggers of a sound, summed up
+struct sound_trigger_t {
+	sound_id_t	sound;
+	unsigned	count;			// Events merged into this trigger
+	float		gain, pan;
+	tick_t		tick;
+};
+
+// Keeps the number of voices started per tick bounded by the number of distinct sounds, not
+// by the number of triggers.  collect() turns a tick's SoundChannel events into one trigger
+// per sound (gains summed up to the limit, pans averaged by gain); apply() then starts a voice
+// for it, or folds it into the voice still playing from inside the window, or drops it when
+// the sound is at max_voices.
+//
+// collect() and apply() keep separate state, so they may run on different threads (one each).
+class SoundCoalescer {
+	struct pending_t {
+		float		gain, pan;		// pan accumulates pan * gain
+		unsigned	count;
+	};
+	struct voice_state_t {
+		int			voice;			// Last voice started for the sound (Mixer::NO_VOICE if none)
+		tick_t		started;
+		float		gain, pan;
+	};
+
+	std::vector<sound_rule_t>		rules_;
+	std::vector<pending_t>			pending_;		// collect() side
+	std::vector<sound_trigger_t>	triggers_;
+	std::vector<voice_state_t>		voices_;		// apply() side
+	unsigned long					merged_, capped_;
+public:
+	static constexpr sound_rule_t DEFAULT_RULE{ 4u, 4u, 2.0f, 0 };
+
+	explicit SoundCoalescer(size_t sounds, const sound_rule_t& rule = DEFAULT_RULE);
+
+	// (only before apply() is in use)
+	void set_rule(sound_id_t sound, const sound_rule_t& rule) { rules_.at(sound) = rule; }
+
+	// Sum up and clear the tick's events (the result is valid until the next call)
+	const std::vector<sound_trigger_t>& collect(SoundChannel& channel, tick_t tick);
+
+	void apply(const sound_trigger_t& trigger, Mixer& mixer);
+
+	// Both of the above, for a single thread
+	void drain(SoundChannel& channel, Mixer& mixer, tick_t tick);
+
+	// (apply() side)
+	unsigned long merged() const { return merged_; }	// Triggers folded into another trigger's voice
+	unsigned long capped() const { return capped_; }	// Triggers dropped by max_voices
+};
+
+// Plays a Mixer through an Allegro audio stream attached to the default mixer
+class AudioStreamOutput {
+	awful::AudioStreamPtr	stream_;
+	size_t					frames_;
+public:
+	AudioStreamOutput(unsigned rate = MIX_RATE, size_t frames = MIX_FRAGMENT_FRAMES, size_t fragments = 4);
+
+	ALLEGRO_EVENT_SOURCE *event_source() const;
+
+	// Has the stream played every fragment it had (i.e., is it waiting on us)?
+	bool starved() const;
+
+	// Fill every fragment the stream has room for; returns how many were filled
+	size_t pump(Mixer& mixer);
+};
+
+// Renders a Mixer offline on a virtual clock locked to the simulation: after every tick it
+// mixes exactly the output frames that fall within that tick (tick * rate / tick_hz, in
+// integers, so nothing drifts) and appends them to a 16-bit stereo WAV file.  Runs as fast as
+// the CPU allows, and the same session always produces the same bytes.
+class WavRenderer {
+	Mixer&					mixer_;
+	SoundCoalescer&			coalescer_;
+	std::ofstream			out_;
+	unsigned				rate_, tick_hz_;
+	uint64_t				frames_;			// Frames written so far
+	std::vector<float>		mix_;
+	Buffer					pcm_;
+	double					mix_seconds_;		// Time spent inside Mixer::mix()
+
+	void write_header();
+public:
+	WavRenderer(const char *path, Mixer& mixer, SoundCoalescer& coalescer, unsigned tick_hz, unsigned rate = MIX_RATE);
+	~WavRenderer();		// Finishes the WAV header
+
+	WavRenderer(const WavRenderer&) = delete;
+	WavRenderer& operator=(const WavRenderer&) = delete;
+
+	// Apply the tick's sound events, then render up to the end of tick <tick>
+	void tick(SoundChannel& channel, tick_t tick);
+
+	uint64_t frames() const { return frames_; }
+	double mix_seconds() const { return mix_seconds_; }
+};
+
+// Owns all audio control: the game thread only enqueues commands (a few stores into a
+// lock-free ring, never blocking), and a dedicated thread applies them to the Mixer and
+// keeps the stream fed.  A long frame on the game thread can delay a sound, but can't
+// starve the stream.  When the ring is full a command is dropped (and counted).
+class AudioThread {
+	struct command_t {
+		enum OP { TRIGGER, SET_GAIN, STOP } op;
+		sound_trigger_t	trigger;		// (SET_GAIN/STOP only use sound, gain, pan)
+	};
+
+	Mixer&							mixer_;
+	SoundCoalescer&					coalescer_;
+	AudioStreamOutput				output_;
+	awful::EventQueuePtr			events_;
+	SpscRing<command_t>				commands_;
+	std::thread						thread_;
+	std::atomic<bool>				stop_;
+	size_t							max_depth_;				// Game thread only
+	unsigned long					sent_, dropped_;		// Game thread only
+	std::atomic<unsigned long>		fragments_, underruns_;	// Audio thread only (read by reports)
+
+	bool send(const command_t& cmd);
+	void run();
+public:
+	AudioThread(Mixer& mixer, SoundCoalescer& coalescer, size_t depth = 256);
+	~AudioThread();
+
+	AudioThread(const AudioThread&) = delete;
+	AudioThread& operator=(const AudioThread&) = delete;
+
+	// Coalesce the tick's sound events and send them
+	void submit(SoundChannel& channel, tick_t tick);
+
+	// Change the gain/pan of every voice playing <sound>
+	bool set_gain(sound_id_t sound, float gain, float pan = 0.0f);
+
+	// Silence <sound> (or everything)
+	bool stop(sound_id_t sound = NO_SOUND);
+
+	size_t depth() const { return commands_.size(); }		// Commands waiting right now
+	size_t max_depth() const { return max_depth_; }
+	unsigned long sent() const { return sent_; }
+	unsigned long dropped() const { return dropped_; }
+	unsigned long fragments() const { return fragments_.load(); }
+	unsigned long underruns() const { return underruns_.load(); }	// Times the stream ran dry
+};
+
+#endif
@@ -34,6 +34,7 @@ ALLEGRO_PTR_DELETER(ALLEGRO_TIMER, al_destroy_timer)
 #ifndef AWFUL_NO_AUDIO
 #include <allegro5/allegro_audio.h>
 ALLEGRO_PTR_DELETER(ALLEGRO_SAMPLE, al_destroy_sample)
+ALLEGRO_PTR_DELETER(ALLEGRO_AUDIO_STREAM, al_destroy_audio_stream)
 #endif
 
 // Define new C++ types inside a namespace
@@ -51,6 +52,7 @@ namespace awful {
 	// Audio types are opt-out
 #ifndef AWFUL_NO_AUDIO
 	using SamplePtr = std::unique_ptr<ALLEGRO_SAMPLE>;
+	using AudioStreamPtr = std::unique_ptr<ALLEGRO_AUDIO_STREAM>;
 #endif
 
 	// RAII type for managing temporary changes of Allegro 5's target bitmap
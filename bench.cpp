@@ -0,0 +1,221 @@
+// ECS scalability benchmark (headless)
+//--------------------------------------
+// Spawns populations of entities with a game-like component mix and times entity creation,
+// each system, random component lookups and world snapshots.  Reports ns/entity and bytes/entity
+// as CSV (default) or JSON on stdout, e.g.:
+//		w2_bench --sizes 1000,10000,100000,1000000 --format json > ecs.json
+
+// Lib C stuff
+#include <cstdlib>
+#include <cstring>
+
+// Lib C++ stuff
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <functional>
+
+// Raw Allegro 5 stuff
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_primitives.h>
+
+// Convenience/safety wrappers for Allegro 5
+#include "awful.h"
+using namespace awful;
+
+// Game-specific headers:
+#include "common.h"		// Common typedefs
+#include "assets.h"		// Resource loading types
+#include "ecs.h"		// Entity/component/system framework
+#include "inputs.h"		// Input mechanism abstraction
+
+// One measured stage for one population size
+struct result_t {
+	size_t		entities;
+	std::string	stage;
+	double		total_ms;
+	double		ns_per_entity;	// Per entity (or per lookup, for the lookup stage)
+	double		bytes_per_entity;
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+// Time <iterations> calls to <fn> (returns average seconds per call)
+static double time_it(size_t iterations, const std::function<void()>& fn) {
+	auto start = bench_clock::now();
+	for (size_t i = 0; i < iterations; ++i) {
+		fn();
+	}
+	return std::chrono::duration<double>(bench_clock::now() - start).count() / iterations;
+}
+
+// Resident bytes in the ECS's pools (by capacity, not size, since that is what is actually held)
+static size_t ecs_bytes(GameECS& ecs) {
+	size_t bytes = ecs.entities.capacity() * sizeof(GameECS::Entity);
+	tuple_foreach<0>(ecs.components, [&bytes](auto& pool) { bytes += pool.capacity() * sizeof(pool[0]); });
+	return bytes;
+}
+
+// Controller that just holds "right" (so grid movers keep moving)
+class HoldRight : public Inputs {
+public:
+	HoldRight() {
+		set_code(INPUT_RIGHT);
+		latch();
+	}
+};
+
+// Spawn <count> entities with a game-like mix:
+//	every entity: CSprite
+//	1 in 2: CAnimation (enemies, effects, pickups)
+//	1 in 10: CGridMover + CHacks (player/AI-driven movers)
+//	1 in 20: CActor
+static void spawn_population(GameECS& ecs, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		float x = float((i * 16) % VGA13_WIDTH), y = float(((i / 20) * 16) % VGA13_HEIGHT);
+		auto e = ecs.make_entity();
+		e.add<CSprite>(ImageBank::sprite_id(i % NUM_SPRITES), x, y);
+		if (i % 2 == 0) { e.add<CAnimation>(static_cast<ANIMATION>(i % NUM_ANIMATIONS), 4); }
+		if (i % 10 == 0) { e.add<CGridMover>().add<CHacks>(true, 0); }
+		if (i % 20 == 0) { e.add<CActor>(static_cast<ACTOR_MODEL>(i % ACTOR_MAX)); }
+	}
+}
+
+static void bench_population(size_t count, size_t lookups, const ImageBank& images, std::vector<result_t>& results) {
+	// Enough repetitions to get ~1M entity-visits per system (but at least one)
+	const size_t reps = std::max<size_t>(1u, 1000000u / count);
+	HoldRight player;
+	std::vector<Inputs *> controllers{ &player };
+
+	// (the frame arena has to hold a full sprite batch--unsorted, plus two radix sort buffers--
+	// and the visibility pass's bounds arrays)
+	GameECS ecs{ GameECS::DEFAULT_SCRATCH_BYTES + (count * 5 * sizeof(sprite_draw_t)) };
+	ecs.reserve(count);
+
+	// Creation
+	auto start = bench_clock::now();
+	spawn_population(ecs, count);
+	double spawn_s = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+	const double bpe = double(ecs_bytes(ecs)) / count;
+	auto record = [&](const char *stage, double seconds, double per) {
+		results.push_back(result_t{ count, stage, seconds * 1e3, (seconds * 1e9) / per, bpe });
+	};
+	record("make_entity_add", spawn_s, double(count));
+
+	// Systems
+	tick_t clock = 0u;
+	record("sys_save_positions", time_it(reps, [&] { ecs.sys_save_positions(); }), double(count));
+	record("sys_user_controls", time_it(reps, [&] { ecs.sys_user_controls(controllers); }), double(count));
+	record("sys_grid_moves", time_it(reps, [&] { ecs.sys_grid_moves(); }), double(count));
+	record("sys_wrap_positions", time_it(reps, [&] { ecs.sys_wrap_positions(); }), double(count));
+	record("sys_animate", time_it(reps, [&] { ecs.sys_animate(++clock); }), double(count));
+	record("sys_render", time_it(std::max<size_t>(1u, reps / 10u), [&] { ecs.sys_render(images, 1.0f); ecs.end_frame(); }), double(count));
+
+	// Same, with every sprite parked far off-screen: this is pure culling cost
+	for (CSprite& s : ecs.get_components<CSprite>()) { s.x += 4096.0f; s.px += 4096.0f; }
+	record("sys_render_offscreen", time_it(reps, [&] { ecs.sys_render(images, 1.0f); ecs.end_frame(); }), double(count));
+	for (CSprite& s : ecs.get_components<CSprite>()) { s.x -= 4096.0f; s.px -= 4096.0f; }
+
+	// Random lookups (by entity ID) into the sprite pool
+	std::mt19937 rng{ 12345u };
+	std::uniform_int_distribution<entity_id_t> pick{ 1u, ecs.eid_seed };
+	std::vector<entity_id_t> eids(lookups);
+	for (entity_id_t& eid : eids) { eid = pick(rng); }
+	size_t found = 0;
+	double lookup_s = time_it(1u, [&] {
+		for (entity_id_t eid : eids) {
+			found += (lookup_component<CSprite>(ecs.get_components<CSprite>(), eid) != nullptr) ? 1u : 0u;
+		}
+	});
+	record("lookup_component", lookup_s, double(lookups));
+	if (found != lookups) { std::cerr << "WARNING: only " << found << " of " << lookups << " lookups hit\n"; }
+
+	// World snapshots (a single history slot is all a round trip needs)
+	ecs.reserve_history(1);
+	record("snapshot", time_it(reps, [&] { ecs.snapshot(clock); }), double(count));
+	record("restore", time_it(reps, [&] { ecs.restore(clock); }), double(count));
+}
+
+static void print_csv(const std::vector<result_t>& results) {
+	std::cout << "entities,stage,total_ms,ns_per_entity,bytes_per_entity\n";
+	for (const result_t& r : results) {
+		std::cout << r.entities << ',' << r.stage << ',' << r.total_ms << ','
+			<< r.ns_per_entity << ',' << r.bytes_per_entity << '\n';
+	}
+}
+
+static void print_json(const std::vector<result_t>& results) {
+	std::cout << "[\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const result_t& r = results[i];
+		std::cout << "  { \"entities\": " << r.entities << ", \"stage\": \"" << r.stage
+			<< "\", \"total_ms\": " << r.total_ms << ", \"ns_per_entity\": " << r.ns_per_entity
+			<< ", \"bytes_per_entity\": " << r.bytes_per_entity << " }"
+			<< ((i + 1 < results.size()) ? ",\n" : "\n");
+	}
+	std::cout << "]\n";
+}
+
+static void usage(const char *argv0) {
+	std::cerr << "usage: " << argv0 << " [--sizes N,N,...] [--lookups N] [--format csv|json]\n";
+}
+
+int main(int argc, char **argv) {
+	std::vector<size_t> sizes{ 1000u, 10000u, 100000u, 1000000u };
+	size_t lookups = 100000u;
+	bool json = false;
+
+	for (int i = 1; i < argc; ++i) {
+		if ((std::strcmp(argv[i], "--sizes") == 0) && (i + 1 < argc)) {
+			sizes.clear();
+			std::istringstream list{ argv[++i] };
+			std::string item;
+			while (std::getline(list, item, ',')) {
+				size_t n = std::strtoul(item.c_str(), nullptr, 10);
+				if (n) { sizes.push_back(n); }
+			}
+		}
+		else if ((std::strcmp(argv[i], "--lookups") == 0) && (i + 1 < argc)) {
+			lookups = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if ((std::strcmp(argv[i], "--format") == 0) && (i + 1 < argc)) {
+			json = (std::strcmp(argv[++i], "json") == 0);
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	// Headless: no display, so all bitmaps (sprites and the render target) live in memory
+	if (!al_init() || !al_init_primitives_addon()) {
+		std::cerr << "Unable to initialize Allegro\n";
+		return 1;
+	}
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+	ResourceBin rsrc{ "RESOURCE.BIN" };
+	SpritesBin sprites{ rsrc, "SPRITES.BIN" };
+	ImageBank images{ sprites };
+
+	BitmapPtr target{ al_create_bitmap(VGA13_WIDTH, VGA13_HEIGHT) };
+	al_set_target_bitmap(target.get());
+
+	std::vector<result_t> results;
+	for (size_t count : sizes) {
+		bench_population(count, lookups, images, results);
+	}
+
+	if (json) {
+		print_json(results);
+	}
+	else {
+		print_csv(results);
+	}
+	return 0;
+}
@@ -0,0 +1,150 @@
+// Asynchronous frame capture (session recording)
+//------------------------------------------------
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "capture.h"
+#include "memory.h"
+#include "trace.h"
+
+static bool has_extension(const std::string& path, const char *ext) {
+	size_t len = std::strlen(ext);
+	return (path.size() >= len) && (path.compare(path.size() - len, len, ext) == 0);
+}
+
+FrameCapture::FrameCapture(const char *path, int fps, bool hashes, size_t depth) :
+	ring_{ depth, slot_t{ false, PackedPalette{}, Buffer(RGBA_BYTES) } }, path_{ path },
+	format_{ has_extension(path_, ".y4m") ? CAPTURE_Y4M : has_extension(path_, ".ppm") ? CAPTURE_PPM : CAPTURE_RAW },
+	fps_{ fps }, yuv_(VGA13_WIDTH * VGA13_HEIGHT * 3), stop_{ false }, pushed_{ 0u }, dropped_{ 0u }, written_{ 0u }
+{
+	if (format_ != CAPTURE_PPM) {
+		out_.open(path_, std::ios::binary);
+		if (!out_) { throw std::exception("Unable to open capture file"); }
+		if (format_ == CAPTURE_Y4M) {
+			out_ << "YUV4MPEG2 W" << VGA13_WIDTH << " H" << VGA13_HEIGHT << " F" << fps_ << ":1 Ip A1:1 C444\n";
+		}
+	}
+	if (hashes) {
+		hashes_.open(path_ + ".hashes");
+		if (!hashes_) { throw std::exception("Unable to open capture hash file"); }
+	}
+
+	writer_ = std::thread{ &FrameCapture::writer_loop, this };
+}
+
+FrameCapture::~FrameCapture() {
+	stop_.store(true);
+	writer_.join();
+}
+
+FrameCapture::slot_t *FrameCapture::claim() {
+	++pushed_;
+	slot_t *slot = ring_.acquire();
+	if (!slot) { ++dropped_; }
+	return slot;
+}
+
+bool FrameCapture::push(ALLEGRO_BITMAP *frame) {
+	slot_t *slot = claim();
+	if (!slot) { return false; }
+
+	ALLEGRO_LOCKED_REGION *lr = al_lock_bitmap(frame, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+	if (!lr) { throw std::exception("Unable to lock ALLEGRO_BITMAP for reading"); }
+	for (size_t y = 0; y < VGA13_HEIGHT; ++y) {
+		std::memcpy(&slot->pixels[y * VGA13_WIDTH * 4], static_cast<const uint8_t *>(lr->data) + (int(y) * lr->pitch), VGA13_WIDTH * 4);
+	}
+	al_unlock_bitmap(frame);
+
+	slot->indexed = false;
+	ring_.publish();
+	return true;
+}
+
+bool FrameCapture::push(const uint8_t *indices, const PackedPalette& palette) {
+	slot_t *slot = claim();
+	if (!slot) { return false; }
+
+	std::memcpy(slot->pixels.data(), indices, VGA13_WIDTH * VGA13_HEIGHT);
+	slot->palette = palette;
+	slot->indexed = true;
+	ring_.publish();
+	return true;
+}
+
+void FrameCapture::writer_loop() {
+	Trace::thread_name("capture");
+	MemoryTag::set(MEM_RENDER);
+	Buffer rgba(RGBA_BYTES);
+	for (;;) {
+		if (slot_t *slot = ring_.peek()) {
+			TRACE_SCOPE("write frame");
+			write_frame(*slot, rgba);
+			ring_.release();
+			written_.fetch_add(1u);
+		}
+		else if (stop_.load()) {
+			break;		// Stopped, and everything queued has been written
+		}
+		else {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	out_.flush();
+	hashes_.flush();
+}
+
+void FrameCapture::write_frame(const slot_t& slot, Buffer& rgba) {
+	// Normalize to RGBA
+	const uint8_t *pixels = slot.pixels.data();
+	if (slot.indexed) {
+		for (size_t i = 0; i < VGA13_WIDTH * VGA13_HEIGHT; ++i) {
+			uint32_t c = slot.palette[pixels[i]];
+			rgba[(i * 4) + 0] = uint8_t(c);
+			rgba[(i * 4) + 1] = uint8_t(c >> 8);
+			rgba[(i * 4) + 2] = uint8_t(c >> 16);
+			rgba[(i * 4) + 3] = uint8_t(c >> 24);
+		}
+		pixels = rgba.data();
+	}
+
+	const unsigned long frame = written_.load();
+	if (hashes_.is_open()) {
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < RGBA_BYTES; ++i) { hash = (hash ^ pixels[i]) * 16777619u; }
+		char line[32];
+		std::snprintf(line, sizeof(line), "%lu %08x\n", frame, hash);
+		hashes_ << line;
+	}
+
+	const size_t count = VGA13_WIDTH * VGA13_HEIGHT;
+	switch (format_) {
+	case CAPTURE_Y4M: {
+		// BT.601 (studio range), full-resolution chroma
+		Buffer& planes = yuv_;
+		for (size_t i = 0; i < count; ++i) {
+			int r = pixels[i * 4], g = pixels[(i * 4) + 1], b = pixels[(i * 4) + 2];
+			planes[i] = uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+			planes[count + i] = uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+			planes[(count * 2) + i] = uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+		}
+		out_ << "FRAME\n";
+		out_.write(reinterpret_cast<const char *>(planes.data()), planes.size());
+		break;
+	}
+	case CAPTURE_PPM: {
+		std::string name = path_.substr(0, path_.size() - 4);
+		char suffix[24];
+		std::snprintf(suffix, sizeof(suffix), "_%05lu.ppm", frame);
+		std::ofstream ppm{ name + suffix, std::ios::binary };
+		ppm << "P6\n" << VGA13_WIDTH << ' ' << VGA13_HEIGHT << "\n255\n";
+		for (size_t i = 0; i < count; ++i) {
+			ppm.write(reinterpret_cast<const char *>(pixels + (i * 4)), 3);
+		}
+		break;
+	}
+	case CAPTURE_RAW:
+		out_.write(reinterpret_cast<const char *>(pixels), RGBA_BYTES);
+		break;
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#ifndef W2DIR_CAPTURE_H
+#define W2DIR_CAPTURE_H
+// Asynchronous frame capture (session recording)
+//------------------------------------------------
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <allegro5/allegro.h>
+
+#include "common.h"
+#include "spsc.h"
+#include "softrender.h"
+
+// Output container, chosen from the capture file's extension
+enum CAPTURE_FORMAT {
+	CAPTURE_Y4M,		// .y4m: YUV4MPEG2 stream (4:4:4), plays in ffmpeg/mpv/VLC
+	CAPTURE_RAW,		// anything else: headerless RGBA frames, back to back
+	CAPTURE_PPM,		// .ppm: one binary PPM per frame (name_00000.ppm, name_00001.ppm, ...)
+};
+
+// Records 320x200 frames to disk without ever stalling the game: push() copies a frame into a
+// preallocated slot of a lock-free ring and returns; a writer thread converts and writes the
+// frames behind it.  If the writer falls behind and the ring is full, the frame is dropped
+// (and counted) instead of waiting.  Optionally writes an FNV-1a hash of every frame's RGBA
+// pixels to <path>.hashes, for comparing runs.
+class FrameCapture {
+	static constexpr size_t RGBA_BYTES = VGA13_WIDTH * VGA13_HEIGHT * 4;
+
+	struct slot_t {
+		bool			indexed;		// <pixels> holds palette indices (expanded through <palette>)...
+		PackedPalette	palette;
+		Buffer			pixels;			// ...or RGBA (R, G, B, A byte order)
+	};
+
+	SpscRing<slot_t>	ring_;
+	std::string			path_;
+	CAPTURE_FORMAT		format_;
+	int					fps_;
+	std::ofstream		out_, hashes_;
+	Buffer				yuv_;					// Writer thread scratch
+	std::thread			writer_;
+	std::atomic<bool>	stop_;
+	unsigned long		pushed_, dropped_;		// Game thread only
+	std::atomic<unsigned long> written_;		// Writer thread only (read by reports)
+
+	void writer_loop();
+	void write_frame(const slot_t& slot, Buffer& rgba);
+	slot_t *claim();
+public:
+	FrameCapture(const char *path, int fps, bool hashes, size_t depth = 32);
+	~FrameCapture();		// Finishes writing everything queued
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	// Queue a copy of a 320x200 bitmap (e.g., RenderBuffer::bitmap()); false if dropped.  Pass a
+	// memory bitmap in ABGR_8888_LE (see RenderBuffer's <readable>) for a plain copy: anything
+	// else is converted, and a video bitmap is read back from the GPU.
+	bool push(ALLEGRO_BITMAP *frame);
+
+	// Queue a copy of an indexed frame and the palette to show it with; false if dropped
+	bool push(const uint8_t *indices, const PackedPalette& palette);
+
+	unsigned long pushed() const { return pushed_; }
+	unsigned long dropped() const { return dropped_; }
+	unsigned long written() const { return written_.load(); }
+};
+
+#endif
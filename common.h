@@ -20,6 +20,13 @@ using Buffer = std::vector<uint8_t>;
 // A VGA Mode 13h color palette type (256 Allegro color definitions)
 using Palette = std::array<ALLEGRO_COLOR, VGA13_COLORS>;
 
+// Typedef for global game clock (simulation ticks)
+using tick_t = unsigned int;
+
+// Paste two tokens after expanding them (for unique names in scope macros: W2DIR_CONCAT(x_, __LINE__))
+#define W2DIR_CONCAT_(a, b) a##b
+#define W2DIR_CONCAT(a, b) W2DIR_CONCAT_(a, b)
+
 
 
 #endif
@@ -0,0 +1,574 @@
+#pragma once
+#ifndef W2DIR_ECS_H
+#define W2DIR_ECS_H
+// Entity/Component/System framework and the game's component types
+//------------------------------------------------------------------
+
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <type_traits>
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_primitives.h>
+
+#include "common.h"		// Common typedefs
+#include "assets.h"		// Resource loading types
+#include "actors.h"		// Animation metadata types/tables
+#include "inputs.h"		// Input mechanism abstraction
+#include "arena.h"		// Pooled storage and per-frame scratch memory
+#include "snapshot.h"	// World state history (save states/rewind)
+#include "render.h"		// Sprite batching
+#include "sounds.h"		// Sound event channel
+
+// Typedef and invalid value for an opaque entity ID
+using entity_id_t = unsigned int;
+constexpr entity_id_t INVALID_EID = 0u;
+
+// Typedef for bitmask telling what components are available for a given entity
+using component_mask_t = unsigned int;
+
+
+
+// Component base: contains the parent entity ID and operator< to sort the component based on that ID
+struct Component {
+	entity_id_t eid;
+
+	explicit Component(entity_id_t eid_) : eid{ eid_ } {}
+
+	bool operator<(const Component& that) const {
+		return eid < that.eid;
+	}
+};
+
+// NOTE: components hold only plain values (IDs/handles, never pointers) so that
+// whole component pools can be memcpy'd in and out of world snapshots
+
+// Component: A basic sprite (screen position and rendering info)
+struct CSprite : public Component {
+	static constexpr component_mask_t Mask = 1;
+
+	image_id_t image;	// ImageBank handle (NO_IMAGE == invisible)
+	float x, y;
+	float px, py;	// Position as of the previous simulation tick (rendering interpolates from here to x/y)
+	int flags;		// Arbitrary flags used by rendering system to alter sprite's appearance
+	SPRITE_LAYER layer;
+
+	CSprite(entity_id_t eid_, image_id_t image_ = NO_IMAGE, float x_ = 0.0f, float y_ = 0.0f, int flags_ = 0, SPRITE_LAYER layer_ = LAYER_ACTORS) :
+		Component{ eid_ }, image{ image_ }, x{ x_ }, y{ y_ }, px{ x_ }, py{ y_ }, flags{ flags_ }, layer{ layer_ } {}
+};
+
+// Component: Animation (metadata for a animating sprite)
+struct CAnimation : public Component {
+	static constexpr component_mask_t Mask = 2;
+
+	// Time base for frame selection (if any) and wobble (if any)
+	tick_t tbase;
+
+	// Animation frames (ANIMATION_TABLE sequence of SpritesBin shapes and clock divider for frame rate)
+	ANIMATION anim;
+	int rate;
+
+	// Palette effect (useful for enemies only)
+	ResourceBin::PALETTE pal;
+	
+	// "Wobble" on the y axis (to be implemented)
+	float wamp;	// max positive amplitude
+	int wper;	// period of an up/down cycle in frame ticks
+
+	CAnimation(entity_id_t eid_, ANIMATION anim_ = ANIM_ANY_NA_POP, int rate_ = 1, ResourceBin::PALETTE pal_ = ResourceBin::PAL_DEFAULT, float wamp_ = 0.0f, int wper_ = 0) :
+		Component{ eid_ }, tbase{ 0u }, anim{ anim_ }, rate{ rate_ }, pal{ pal_ }, wamp{ wamp_ }, wper{ wper_ } {}
+
+};
+
+// Component: Actor (multi-direction/action animated model)
+struct CActor : public Component {
+	static constexpr component_mask_t Mask = 4;
+
+	ACTOR_MODEL model;	// Index into MODEL_TABLE
+	ACTOR_DIRECTION dir;
+	ACTOR_ACTION action;
+
+	CActor(entity_id_t eid_, ACTOR_MODEL model_ = ACTOR_CUBY, ACTOR_DIRECTION dir_ = DIR_DOWN, ACTOR_ACTION action_ = ACTION_IDLE) :
+		Component{ eid_ }, model{ model_ }, dir{ dir_ }, action{ action_ } {}
+};
+
+enum class GridDirection {
+	Down = DIR_DOWN,
+	Left = DIR_LEFT,
+	Up = DIR_UP,
+	Right = DIR_RIGHT
+};
+
+inline std::pair<float, float> direction_delta(GridDirection dir, float scale = 1.0f) {
+	switch (dir) {
+	case GridDirection::Down:
+		return{ 0.f, scale };
+	case GridDirection::Left:
+		return{ -scale, 0.f };
+	case GridDirection::Up:
+		return{ 0.f, -scale };
+	case GridDirection::Right:
+		return{ scale, 0.f };
+	default:
+		return{ 0.f, 0.f };
+	}
+}
+
+// Component: Grid mover (dynamic entity whose movement is constrained by the 16x16 grid)
+struct CGridMover : public Component {
+	static constexpr component_mask_t Mask = 8;
+
+	bool moving;				// TRUE if the entity is moving
+	float dx, dy;				// Actual screen motion deltas
+	ACTOR_DIRECTION cur_dir;	// Actual facing direction of current movement (useful for Actors)
+
+	// Control intent indicators
+	bool			should_move;
+	GridDirection	move_dir;
+	float			move_scale;
+
+	sound_id_t		step_sound;		// Played whenever a move starts (or NO_SOUND)
+
+	CGridMover(entity_id_t eid_, bool moving_ = false, bool should_move_ = false, GridDirection move_dir_ = GridDirection::Down, float move_scale_ = 1.0f, sound_id_t step_sound_ = NO_SOUND) :
+		Component{ eid_ }, moving{ moving_}, dx{ 0.0f }, dy{ 0.0f }, cur_dir{ (ACTOR_DIRECTION)move_dir_ },
+		should_move{ should_move_ }, move_dir{ move_dir_ }, move_scale{ move_scale_ }, step_sound{ step_sound_ } {}
+};
+
+// Index into the controller table handed to sys_user_controls
+using controller_id_t = int;
+constexpr controller_id_t NO_CONTROLLER = -1;
+
+// Component: "Hacks" component for general experimentation
+struct CHacks : public Component {
+	static constexpr component_mask_t Mask = 16;
+
+	bool wrap_to_screen;			// If true, wrap this [sprite-equipped] entity to the VGA screen
+	controller_id_t controller;		// If not NO_CONTROLLER, use this to deduce the intent of our GridMoCtrl (if any)
+
+	CHacks(entity_id_t eid_, bool wrap_to_screen_ = false, controller_id_t controller_ = NO_CONTROLLER) :
+		Component{ eid_ }, wrap_to_screen{ wrap_to_screen_ }, controller{ controller_ } {}
+};
+
+// Insert a component (by move-assignment) into a vector of that type of component,
+// keeping the vector sorted by entity ID (for fast binary search later)
+template<typename ComponentType, typename ContainerType = std::vector<ComponentType>>
+ComponentType& insert_component(ContainerType& container, ComponentType&& component) {
+	auto target = std::upper_bound(container.begin(), container.end(), component);
+	auto place = container.insert(target, std::move(component));
+	return *place;
+}
+
+// Construct a component in place (from its entity ID and ctor args) inside a vector of that type,
+// keeping the vector sorted by entity ID (no temporary is built when appending, the usual case)
+template<typename ComponentType, typename ContainerType, typename... Args>
+ComponentType& emplace_component(ContainerType& container, entity_id_t eid, Args&&... args) {
+	auto target = std::upper_bound(container.begin(), container.end(), eid,
+		[](entity_id_t id, const Component& c) { return id < c.eid; });
+	auto place = container.emplace(target, eid, std::forward<Args>(args)...);
+	return *place;
+}
+
+// Look up a component of a given type from a container of the same by entity ID (using binary search)
+// If no matching component is found, returns nullptr
+template<typename ComponentType, typename ContainerType = std::vector<ComponentType>>
+ComponentType* lookup_component(ContainerType& container, entity_id_t eid) {
+	auto place = std::lower_bound(container.begin(), container.end(), eid,
+		[](const Component& c, entity_id_t id) { return c.eid < id; });
+	if ((place == container.end()) || (place->eid != eid)) {
+		return nullptr;
+	}
+	else {
+		return &*place;
+	}
+}
+
+// Compile-time-recursive foreach-tuple implementation inspired by (http://stackoverflow.com/questions/1198260/iterate-over-tuple/6894436#6894436)
+template<size_t Index, typename Func, typename... Pack>
+inline typename std::enable_if<Index == sizeof...(Pack)>::type tuple_foreach(std::tuple<Pack...>& tup, Func fun) {} // Terminal case (no-op)
+
+template<size_t Index, typename Func, typename... Pack>
+inline typename std::enable_if<Index < sizeof...(Pack)>::type tuple_foreach(std::tuple<Pack...>& tup, Func fun) {
+	fun(std::get<Index>(tup));							// Invoke payload...
+	tuple_foreach<Index + 1, Func, Pack...>(tup, fun);	// ...and recurse
+}
+
+
+// Advance an iterator-to-Component-collection until it hits the end or an entity ID >= the target
+// (Returns TRUE if it hit the target, FALSE otherwise)
+template<typename ComponentType, typename IteratorType = typename Pool<ComponentType>::iterator>
+bool sync_iterator(entity_id_t eid, IteratorType& iter, const IteratorType& end) {
+	while ((iter != end) && (iter->eid < eid)) { ++iter; }
+	return (iter == end) ? false : (iter->eid == eid);
+}
+
+// An entity/component framework that supports a given list of component types (all subtypes of Component)
+template<typename... ComponentTypes>
+struct ECS {
+
+	// Plain-old-data entity record (no back-pointers, so the entity list can be snapshotted)
+	struct Entity {
+		entity_id_t				id;		// Arbitrary/unique/opaque entity identifier
+		component_mask_t		cmask;	// Bitmask of what components this has
+
+		Entity(entity_id_t eid) : id{ eid }, cmask{ 0u } {}
+
+		bool has_all(component_mask_t mask) {
+			return (cmask & mask) == mask;
+		}
+
+		bool has_any(component_mask_t mask) {
+			return (cmask & mask);
+		}
+	};
+
+	// Short-lived handle returned by make_entity() for chaining add<>() calls
+	struct EntityBuilder {
+		ECS<ComponentTypes...>&	sys;	// Reference back to parent system
+		size_t					index;	// Position of our Entity in sys.entities
+
+		entity_id_t id() const { return sys.entities[index].id; }
+
+		// Construct and instance of type ComponentType with the given arguments and insert
+		// it into the corresponding vector-of-ComponenntType we have in our parent ECS system...
+		template<typename ComponentType, typename... Args>
+		EntityBuilder& add(Args&&... args) {
+			Entity& e = sys.entities[index];
+			Pool<ComponentType>& collection = sys.template get_components<ComponentType>();
+			emplace_component<ComponentType>(collection, e.id, std::forward<Args>(args)...);
+			e.cmask |= ComponentType::Mask;
+			return *this;
+		}
+	};
+
+	// Fixed-size header at the start of every world snapshot
+	struct SnapshotHeader {
+		entity_id_t	eid_seed;
+		uint32_t	counts[1 + sizeof...(ComponentTypes)];	// Entity count, then each component pool's count
+	};
+
+	// Default size of the per-frame scratch arena
+	static constexpr size_t DEFAULT_SCRATCH_BYTES = 256u * 1024u;
+
+	// This system's current max ID
+	entity_id_t eid_seed;
+
+	// The official game objects
+	Pool<Entity> entities;
+
+	// And the pools of components that make them up
+	std::tuple<Pool<ComponentTypes>...> components;
+
+	// Scratch memory for systems' per-frame temporaries (released by end_frame())
+	FrameArena scratch;
+
+	// Per-tick world state history (sized by reserve_history())
+	SnapshotRing history;
+
+	// Sounds requested by systems this tick (drained by the audio side; not part of snapshots)
+	SoundChannel sounds;
+
+	explicit ECS(size_t scratch_bytes = DEFAULT_SCRATCH_BYTES) : eid_seed{ 0 }, scratch{ scratch_bytes } {}
+
+	// Level-load hint: size the entity list and every component pool for <max_entities>
+	// up front, so that spawning during play never has to grow (reallocate) them
+	void reserve(size_t max_entities) {
+		entities.reserve(max_entities);
+		tuple_foreach<0>(components, [max_entities](auto& pool) { pool.reserve(max_entities); });
+	}
+
+	// Finer-grained hint for a single component type (e.g., a level with few actors but lots of sprites)
+	template<typename ComponentType>
+	void reserve_components(size_t count) {
+		get_components<ComponentType>().reserve(count);
+	}
+
+	// Frame boundary: everything systems took from <scratch> this frame is released at once
+	void end_frame() {
+		scratch.reset();
+	}
+
+	// The entity list will always be sorted--we always add new entities at the back,
+	// and each new entity has an ID greater than all the previous ones (up until rollover--LOL)
+	EntityBuilder make_entity() {
+		entities.emplace_back(++eid_seed);
+		return EntityBuilder{ *this, entities.size() - 1 };
+	}
+
+	// Bytes a snapshot of the world as it is now takes
+	size_t snapshot_size() {
+		size_t bytes = snapshot_align(sizeof(SnapshotHeader)) + snapshot_align(entities.size() * sizeof(Entity));
+		tuple_foreach<0>(components, [&bytes](auto& pool) {
+			bytes += snapshot_align(pool.size() * sizeof(pool[0]));
+		});
+		return bytes;
+	}
+
+	// Worst-case bytes a snapshot can take, given the pools' current capacities
+	size_t snapshot_capacity() {
+		size_t bytes = snapshot_align(sizeof(SnapshotHeader)) + snapshot_align(entities.capacity() * sizeof(Entity));
+		tuple_foreach<0>(components, [&bytes](auto& pool) {
+			bytes += snapshot_align(pool.capacity() * sizeof(pool[0]));
+		});
+		return bytes;
+	}
+
+	// Preallocate room for <ticks> snapshots (call after reserve(), since slots are sized from pool capacities)
+	void reserve_history(size_t ticks) {
+		history.allocate(ticks, snapshot_capacity());
+	}
+
+	// Copy the world state (entity list plus every component pool) into the history ring,
+	// tagged with <tick>. Returns false if there is no history or the world outgrew its slots.
+	bool snapshot(tick_t tick) {
+		static_assert(std::is_trivially_copyable<Entity>::value, "Entities must be plain data to be snapshotted");
+
+		// (checked before a slot is claimed, so a snapshot that doesn't fit leaves the ring untouched)
+		if (snapshot_size() > history.slot_bytes()) { return false; }
+		uint8_t *base = history.acquire(tick);
+		if (!base) { return false; }
+
+		SnapshotHeader *hdr = reinterpret_cast<SnapshotHeader *>(base);
+		size_t offset = snapshot_align(sizeof(SnapshotHeader));
+		size_t column = 0;
+		auto save_column = [&](auto& pool) {
+			using T = typename std::remove_reference<decltype(pool)>::type::value_type;
+			static_assert(std::is_trivially_copyable<T>::value, "Components must be plain data to be snapshotted");
+
+			size_t bytes = pool.size() * sizeof(T);
+			hdr->counts[column++] = static_cast<uint32_t>(pool.size());
+			std::memcpy(base + offset, pool.data(), bytes);
+			offset += snapshot_align(bytes);
+		};
+
+		hdr->eid_seed = eid_seed;
+		save_column(entities);
+		tuple_foreach<0>(components, save_column);
+
+		history.commit(offset);
+		return true;
+	}
+
+	// Roll the world back to the snapshot tagged <tick> (discarding all later snapshots).
+	// Returns false if that tick is no longer in the history ring.
+	bool restore(tick_t tick) {
+		const uint8_t *base = history.find(tick);
+		if (!base) { return false; }
+
+		const SnapshotHeader *hdr = reinterpret_cast<const SnapshotHeader *>(base);
+		size_t offset = snapshot_align(sizeof(SnapshotHeader));
+		size_t column = 0;
+		auto load_column = [&](auto& pool) {
+			using T = typename std::remove_reference<decltype(pool)>::type::value_type;
+			const T *src = reinterpret_cast<const T *>(base + offset);
+			size_t count = hdr->counts[column++];
+			pool.assign(src, src + count);		// Fits in reserved capacity (no allocation)
+			offset += snapshot_align(count * sizeof(T));
+		};
+
+		eid_seed = hdr->eid_seed;
+		load_column(entities);
+		tuple_foreach<0>(components, load_column);
+
+		history.truncate_after(tick);
+		return true;
+	}
+
+	template<typename ComponentType>
+	Pool<ComponentType>& get_components() {
+		return std::get<Pool<ComponentType>>(components);
+	}
+
+	// TODO: use some magic template-fu to make a generic
+	// "iterate over all entities with X components and call
+	// this callable passing in references to those components"
+
+
+	// Start of a simulation tick: remember where every sprite was (for render interpolation)
+	void sys_save_positions() {
+		for (CSprite& s : get_components<CSprite>()) {
+			s.px = s.x;
+			s.py = s.y;
+		}
+	}
+
+	// Drive user-control of grid movers (CHacks::controller indexes <controllers>)
+	void sys_user_controls(const std::vector<Inputs *>& controllers) {
+		Pool<CGridMover>&	movers = get_components<CGridMover>();
+		Pool<CHacks>&		hacks = get_components<CHacks>();
+
+		auto imover = movers.begin();
+		auto ihack = hacks.begin();
+
+		// For each entity...
+		for (Entity& e : entities) {
+			if (e.has_all(CGridMover::Mask | CHacks::Mask) && sync_iterator<CGridMover>(e.id, imover, movers.end()) && sync_iterator<CHacks>(e.id, ihack, hacks.end())) {
+				CGridMover& mover = *imover;
+				CHacks& hack = *ihack;
+
+				if ((hack.controller >= 0) && (size_t(hack.controller) < controllers.size())) {
+					// (one direction wins when several are held: left, right, up, then down)
+					const uint8_t held = controllers[hack.controller]->buttons();
+					mover.should_move = (held & (INPUT_LEFT | INPUT_RIGHT | INPUT_UP | INPUT_DOWN)) != 0;
+					if (held & INPUT_LEFT) { mover.move_dir = GridDirection::Left; }
+					else if (held & INPUT_RIGHT) { mover.move_dir = GridDirection::Right; }
+					else if (held & INPUT_UP) { mover.move_dir = GridDirection::Up; }
+					else if (held & INPUT_DOWN) { mover.move_dir = GridDirection::Down; }
+				}
+			}
+		}
+	}
+
+	// Drive grid-locked motion
+	void sys_grid_moves() {
+		Pool<CSprite>&		sprites = get_components<CSprite>();
+		Pool<CGridMover>&	movers = get_components<CGridMover>();
+
+		auto isprite = sprites.begin();
+		auto imover = movers.begin();
+
+		// For each entity...
+		for (Entity& e : entities) {
+			if (e.has_all(CSprite::Mask | CGridMover::Mask) && sync_iterator<CSprite>(e.id, isprite, sprites.end()) && sync_iterator<CGridMover>(e.id, imover, movers.end())) {
+				CSprite& sprite = *isprite;
+				CGridMover& mover = *imover;
+
+				if (mover.moving) {
+					// Move!
+					sprite.x += mover.dx;
+					sprite.y += mover.dy;
+
+					// Have we entered a rest position?
+					if ((int(sprite.x) % 16 == 0) && (int(sprite.y) % 16 == 0)) {
+						// End busy mode (and stop moving)...
+						mover.moving = false;
+						mover.dx = mover.dy = 0.0f;
+					}
+				}
+				else {
+					// We are open to changing state
+					if (mover.should_move) {
+						mover.cur_dir = (ACTOR_DIRECTION)mover.move_dir;
+						std::tie(mover.dx, mover.dy) = direction_delta(mover.move_dir, mover.move_scale);
+						mover.moving = true;
+						if (mover.step_sound != NO_SOUND) {
+							sounds.emit(mover.step_sound, sprite.x + (SPRITE_WIDTH / 2));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Sync grid motion with actor orientation/action
+	void sys_grid_actors() {
+
+	}
+
+	// Drive animations
+	void sys_animate(tick_t game_clock) {
+		auto& animats = get_components<CAnimation>();
+		auto& sprites = get_components<CSprite>();
+
+		auto ianimat = animats.begin();
+		auto isprite = sprites.begin();
+		
+		// For each entity...
+		for (Entity& e : entities) {
+			if (e.has_all(CAnimation::Mask | CSprite::Mask) && sync_iterator<CSprite>(e.id, isprite, sprites.end()) && sync_iterator<CAnimation>(e.id, ianimat, animats.end())) {
+				CSprite& sprite = *isprite;
+				CAnimation& animat = *ianimat;
+
+				// Update the SPRITE's image based on the computed frame (and known palette) of ANIMATION
+				auto clock = (game_clock - animat.tbase) / animat.rate;
+				sprite.image = ImageBank::sprite_id(compute_frame(ANIMATION_TABLE[animat.anim], clock), animat.pal);
+			}
+		}
+	}
+
+	// Keep screen-wrapping entities (CHacks::wrap_to_screen) on the VGA screen; previous positions
+	// shift by the same amount, so render interpolation doesn't streak across the screen
+	void sys_wrap_positions() {
+		Pool<CSprite>&	sprites = get_components<CSprite>();
+		auto isprite = sprites.begin();
+
+		for (CHacks& hack : get_components<CHacks>()) {
+			if (hack.wrap_to_screen && sync_iterator<CSprite>(hack.eid, isprite, sprites.end())) {
+				CSprite& s = *isprite;
+				float dx = -std::floor(s.x / VGA13_WIDTH) * VGA13_WIDTH;
+				float dy = -std::floor(s.y / VGA13_HEIGHT) * VGA13_HEIGHT;
+				s.x += dx;
+				s.px += dx;
+				s.y += dy;
+				s.py += dy;
+			}
+		}
+	}
+
+	// Queue every visible CSprite (resolving image handles through <images>) into a new batch,
+	// <alpha> of the way between their previous and current simulated positions.
+	// Bounds are gathered into flat arrays and culled in one pass; screen-wrapping sprites that
+	// straddle an edge also get a draw on the opposite side for each edge they cross.
+	SpriteBatch sys_collect_sprites(const ImageBank& images, float alpha) {
+		Pool<CSprite>&	sprites = get_components<CSprite>();
+		Pool<CHacks>&	hacks = get_components<CHacks>();
+		const size_t	count = sprites.size();
+
+		float	*xs = scratch.alloc_array<float>(count);
+		float	*ys = scratch.alloc_array<float>(count);
+		float	*ws = scratch.alloc_array<float>(count);
+		float	*hs = scratch.alloc_array<float>(count);
+		uint8_t	*wraps = scratch.alloc_array<uint8_t>(count);
+		uint8_t	*visible = scratch.alloc_array<uint8_t>(count);
+
+		// Gather interpolated bounds (imageless sprites get empty boxes, which never pass the cull)
+		size_t num_wraps = 0;
+		auto ihack = hacks.begin();
+		for (size_t i = 0; i < count; ++i) {
+			const CSprite& s = sprites[i];
+			xs[i] = s.px + ((s.x - s.px) * alpha);
+			ys[i] = s.py + ((s.y - s.py) * alpha);
+			ws[i] = (s.image != NO_IMAGE) ? images.width(s.image) : 0.0f;
+			hs[i] = (s.image != NO_IMAGE) ? images.height(s.image) : 0.0f;
+			wraps[i] = (s.image != NO_IMAGE) && sync_iterator<CHacks>(s.eid, ihack, hacks.end()) && ihack->wrap_to_screen;
+			num_wraps += wraps[i];
+		}
+
+		const size_t shown = cull_to_screen(xs, ys, ws, hs, count, visible);
+
+		// Emit draws (a wrapped sprite can show up in as many as 4 places, near a corner)
+		SpriteBatch batch{ scratch, shown + (num_wraps * 3) };
+		for (size_t i = 0; i < count; ++i) {
+			const CSprite& s = sprites[i];
+			if (wraps[i]) {
+				const float sw = float(VGA13_WIDTH), sh = float(VGA13_HEIGHT);
+				for (float oy = -sh; oy <= sh; oy += sh) {
+					for (float ox = -sw; ox <= sw; ox += sw) {
+						float x = xs[i] + ox, y = ys[i] + oy;
+						if ((x < sw) && (x + ws[i] > 0.0f) && (y < sh) && (y + hs[i] > 0.0f)) {
+							batch.add(s.image, images.bitmap(s.image), x, y, s.layer, images.atlas(s.image), s.flags);
+						}
+					}
+				}
+			}
+			else if (visible[i]) {
+				batch.add(s.image, images.bitmap(s.image), xs[i], ys[i], s.layer, images.atlas(s.image), s.flags);
+			}
+		}
+		return batch;
+	}
+
+	// Render every visible sprite (draws are ordered by layer/depth and batched by atlas; returns the number
+	// of atlas runs actually submitted)
+	size_t sys_render(const ImageBank& images, float alpha) {
+		SpriteBatch batch = sys_collect_sprites(images, alpha);
+		return batch.submit();
+	}
+};
+
+// The concrete E/C manager used by the game
+using GameECS = ECS<CSprite, CAnimation, CActor, CGridMover, CHacks>;
+
+#endif
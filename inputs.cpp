@@ -1,22 +1,181 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include "inputs.h"
 
-void KeyboardInputs::update(const ALLEGRO_EVENT& ev) {
-	if ((ev.type != ALLEGRO_EVENT_KEY_DOWN) && (ev.type != ALLEGRO_EVENT_KEY_UP)) return;
+static_assert(sizeof(InputRecording::header_t) == 16, "InputRecording header must match the file layout");
 
-	bool state = (ev.type == ALLEGRO_EVENT_KEY_DOWN) ? true : false;
-	if (ev.keyboard.keycode == key_down_) {
-		down_ = state;
+// Length of the ticks covered by one run entry
+static tick_t run_length(uint16_t run) { return tick_t(run >> 5) + 1u; }
+
+void KeyboardInputs::bind(int keycode, size_t player, INPUT_BIT bit) {
+	if ((keycode <= 0) || (size_t(keycode) >= keys_.size()) || (player >= players_.size())) {
+		throw std::exception("KeyboardInputs::bind keycode or player out of range");
 	}
-	else if (ev.keyboard.keycode == key_left_) {
-		left_ = state;
+	keys_[keycode] = binding_t{ static_cast<uint8_t>(player), static_cast<uint8_t>(bit) };
+}
+
+void KeyboardInputs::bind(size_t player, int key_down, int key_left, int key_up, int key_right, int key_fire) {
+	bind(key_down, player, INPUT_DOWN);
+	bind(key_left, player, INPUT_LEFT);
+	bind(key_up, player, INPUT_UP);
+	bind(key_right, player, INPUT_RIGHT);
+	bind(key_fire, player, INPUT_FIRE);
+}
+
+bool KeyboardInputs::update(const ALLEGRO_EVENT& ev) {
+	if ((ev.type != ALLEGRO_EVENT_KEY_DOWN) && (ev.type != ALLEGRO_EVENT_KEY_UP)) { return false; }
+	if ((ev.keyboard.keycode <= 0) || (size_t(ev.keyboard.keycode) >= keys_.size())) { return false; }
+
+	const binding_t b = keys_[ev.keyboard.keycode];
+	if (!b.mask) { return false; }
+
+	uint8_t& held = players_[b.player].held_;
+	const uint8_t before = held;
+	held = (ev.type == ALLEGRO_EVENT_KEY_DOWN) ? uint8_t(held | b.mask) : uint8_t(held & ~b.mask);
+	return held != before;
+}
+
+bool ScriptedInputs::load(const char *filename) {
+	std::ifstream in{ filename };
+	if (!in) { return false; }
+
+	changes_.clear();
+	next_ = 0u;
+
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || (line[0] == '#')) { continue; }
+
+		std::istringstream fields{ line };
+		change_t c{ 0u, 0u };
+		std::string held;
+		if (!(fields >> c.tick >> held)) { return false; }
+
+		for (char ch : held) {
+			switch (ch) {
+			case 'D': c.code |= INPUT_DOWN; break;
+			case 'L': c.code |= INPUT_LEFT; break;
+			case 'U': c.code |= INPUT_UP; break;
+			case 'R': c.code |= INPUT_RIGHT; break;
+			case 'F': c.code |= INPUT_FIRE; break;
+			case '-': break;
+			default: return false;
+			}
+		}
+		changes_.push_back(c);
 	}
-	else if (ev.keyboard.keycode == key_up_) {
-		up_ = state;
+
+	std::stable_sort(changes_.begin(), changes_.end(),
+		[](const change_t& a, const change_t& b) { return a.tick < b.tick; });
+	return true;
+}
+
+void ScriptedInputs::seek(tick_t tick) {
+	while ((next_ < changes_.size()) && (changes_[next_].tick <= tick)) {
+		set_code(changes_[next_++].code);
 	}
-	else if (ev.keyboard.keycode == key_right_) {
-		right_ = state;
+}
+void InputRecording::record(tick_t tick, const std::vector<Inputs *>& controllers) {
+	if (tick < ticks_) { truncate(tick); }
+
+	// (a skipped tick repeats this tick's state)
+	for (; ticks_ <= tick; ++ticks_) {
+		for (size_t p = 0; p < runs_.size(); ++p) {
+			uint8_t code = (p < controllers.size()) ? controllers[p]->code() : 0u;
+			std::vector<uint16_t>& runs = runs_[p];
+			if (!runs.empty() && ((runs.back() & INPUT_CODE_MASK) == code) && (run_length(runs.back()) < MAX_RUN)) {
+				runs.back() += uint16_t(1u << 5);
+			}
+			else {
+				runs.push_back(code);
+			}
+		}
+	}
+}
+
+void InputRecording::truncate(tick_t tick) {
+	if (tick >= ticks_) { return; }
+	for (auto& runs : runs_) {
+		tick_t end = ticks_;
+		while (end > tick) {
+			tick_t len = run_length(runs.back());
+			if (end - len >= tick) {
+				runs.pop_back();
+				end -= len;
+			}
+			else {
+				runs.back() -= uint16_t((end - tick) << 5);
+				end = tick;
+			}
+		}
+	}
+	ticks_ = tick;
+}
+
+size_t InputRecording::file_bytes() const {
+	size_t bytes = sizeof(header_t) + ((runs_.size() + 1) * sizeof(uint32_t));
+	for (const auto& runs : runs_) { bytes += runs.size() * sizeof(uint16_t); }
+	return bytes;
+}
+
+bool InputRecording::save(const char *filename) const {
+	std::ofstream out{ filename, std::ios::binary };
+	if (!out) { return false; }
+
+	header_t hdr{ { 'W', '2', 'I', 'R' }, VERSION, static_cast<uint16_t>(runs_.size()), ticks_, 0u };
+	std::vector<uint32_t> first;
+	for (const auto& runs : runs_) {
+		first.push_back(hdr.runs);
+		hdr.runs += static_cast<uint32_t>(runs.size());
+	}
+	first.push_back(hdr.runs);
+
+	out.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+	out.write(reinterpret_cast<const char *>(first.data()), first.size() * sizeof(uint32_t));
+	for (const auto& runs : runs_) {
+		out.write(reinterpret_cast<const char *>(runs.data()), runs.size() * sizeof(uint16_t));
+	}
+	return bool(out);
+}
+
+bool InputRecording::load(const char *filename) {
+	std::ifstream in{ filename, std::ios::binary };
+	if (!in) { return false; }
+	Buffer data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	header_t hdr;
+	if (data.size() < sizeof(hdr)) { return false; }
+	std::memcpy(&hdr, data.data(), sizeof(hdr));
+	if ((std::memcmp(hdr.magic, "W2IR", 4) != 0) || (hdr.version != VERSION) || !hdr.players) { return false; }
+
+	const size_t table = sizeof(hdr), body = table + ((size_t(hdr.players) + 1) * sizeof(uint32_t));
+	if (data.size() != body + (size_t(hdr.runs) * sizeof(uint16_t))) { return false; }
+
+	std::vector<uint32_t> first(size_t(hdr.players) + 1);
+	std::memcpy(first.data(), &data[table], first.size() * sizeof(uint32_t));
+
+	runs_.assign(hdr.players, std::vector<uint16_t>{});
+	for (size_t p = 0; p < hdr.players; ++p) {
+		if ((first[p] > first[p + 1]) || (first[p + 1] > hdr.runs)) { return false; }
+		runs_[p].resize(first[p + 1] - first[p]);
+		std::memcpy(runs_[p].data(), &data[body + (first[p] * sizeof(uint16_t))], runs_[p].size() * sizeof(uint16_t));
+	}
+	ticks_ = hdr.ticks;
+	return true;
+}
+
+void ReplayInputs::seek(tick_t tick) {
+	if (tick < start_) {
+		run_ = 0u;
+		start_ = 0u;
 	}
-	else if (ev.keyboard.keycode == key_fire_) {
-		fire_ = state;
+	while ((run_ + 1 < runs_.size()) && (tick >= start_ + run_length(runs_[run_]))) {
+		start_ += run_length(runs_[run_]);
+		++run_;
 	}
-}
\ No newline at end of file
+	if (run_ < runs_.size()) { set_code(runs_[run_] & INPUT_CODE_MASK); }
+}
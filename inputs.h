@@ -1,35 +1,155 @@
 #pragma once
+#include <vector>
 #include <allegro5/events.h>
+#include <allegro5/keycodes.h>
+#include "common.h"
 
-// Abstraction of a player input (directions and "fire")
+// Bits of an input code (one player's whole input state in 5 bits)
+enum INPUT_BIT : uint8_t {
+	INPUT_DOWN = 1,
+	INPUT_LEFT = 2,
+	INPUT_UP = 4,
+	INPUT_RIGHT = 8,
+	INPUT_FIRE = 16,
+	INPUT_CODE_MASK = 31,
+};
+
+// One player's input (directions and "fire") as INPUT_BIT masks.  Sources (subclasses) set
+// the live state whenever they like; latch() takes it for the next simulation tick and keeps
+// the previous tick's, so systems get stable per-tick state plus pressed/released edges.
 class Inputs {
 protected:
-	// Protected concrete storage (can be manipulated by subclasses
-	bool down_, left_, up_, right_, fire_;
+	uint8_t held_;			// Live state (set by subclasses)
+	uint8_t now_, last_;	// Latched for this tick and the one before
+
+	void set_code(uint8_t code) { held_ = code & INPUT_CODE_MASK; }
+
+public:
+	Inputs() : held_{ 0u }, now_{ 0u }, last_{ 0u } { }
+
+	// Start of a simulation tick
+	void latch() {
+		last_ = now_;
+		now_ = held_;
+	}
+
+	// This tick's state
+	uint8_t buttons() const { return now_; }
+	uint8_t pressed() const { return uint8_t(now_ & ~last_); }
+	uint8_t released() const { return uint8_t(~now_ & last_); }
+
+	bool down() const { return (now_ & INPUT_DOWN) != 0; }
+	bool left() const { return (now_ & INPUT_LEFT) != 0; }
+	bool up() const { return (now_ & INPUT_UP) != 0; }
+	bool right() const { return (now_ & INPUT_RIGHT) != 0; }
+	bool fire() const { return (now_ & INPUT_FIRE) != 0; }
+
+	// The live state (what the next latch() will take)
+	uint8_t code() const { return held_; }
+};
+
+
+// Feeds any number of players from one stream of Allegro keyboard events: each keycode maps
+// straight to a (player, bit) pair, so an event costs one table lookup
+class KeyboardInputs {
+	struct binding_t {
+		uint8_t		player;
+		uint8_t		mask;			// INPUT_BIT (0: key not bound)
+	};
+
+	// A player whose state only KeyboardInputs sets
+	class Player : public Inputs {
+		friend class KeyboardInputs;
+	};
+
+	std::vector<binding_t>	keys_;		// Indexed by keycode
+	std::vector<Player>		players_;
+public:
+	explicit KeyboardInputs(size_t players = 1) : keys_(ALLEGRO_KEY_MAX, binding_t{ 0u, 0u }), players_(players) {}
 
+	void bind(int keycode, size_t player, INPUT_BIT bit);
+
+	// Bind all five buttons of <player>
+	void bind(size_t player, int key_down, int key_left, int key_up, int key_right, int key_fire);
+
+	// Apply a key event; true if it changed some player's state
+	bool update(const ALLEGRO_EVENT& ev);
+
+	size_t players() const { return players_.size(); }
+	Inputs& player(size_t index) { return players_.at(index); }
+};
+
+
+// Concrete Inputs subclass driven by a text script (for headless runs), one change per line:
+//   <tick> <held buttons>		e.g. "64 RF" (right+fire held from tick 64 on) or "128 -" (nothing held)
+// using D/L/U/R/F for down/left/up/right/fire; blank lines and lines starting with '#' are ignored
+class ScriptedInputs : public Inputs {
+	struct change_t {
+		tick_t	tick;
+		uint8_t	code;
+	};
+	std::vector<change_t> changes_;		// Sorted by tick
+	size_t next_;						// Next change to apply
 public:
-	Inputs() : down_(false), left_(false), up_(false), right_(false), fire_(false) { }
+	ScriptedInputs() : next_{ 0u } {}
 
-	// Concrete getters for input state
-	bool down() const { return down_; }
-	bool left() const { return left_; }
-	bool up() const { return up_; }
-	bool right() const { return right_; }
-	bool fire() const { return fire_; }
+	// Parse a script file (returns false if it can't be read or has a malformed line)
+	bool load(const char *filename);
+
+	// Apply every change scheduled at or before <tick> (call once per simulation tick)
+	void seek(tick_t tick);
 
-	// Virtual ALLEGRO_EVENT handler
-	virtual void update(const ALLEGRO_EVENT& ev) = 0;
 };
 
 
-// Concrete Inputs subclass driven by Allegro keyboard events
-class KeyboardInputs : public Inputs {
-	// Allegro key-code mappings for the movements requested
-	int key_down_, key_left_, key_up_, key_right_, key_fire_;
+// Per-tick input codes of every player, run-length encoded.  The file is the in-memory
+// layout, so it can be mapped/loaded and used in place (all fields little-endian):
+//   header_t
+//   uint32_t first[players + 1]		player p's runs are runs[first[p]] up to runs[first[p + 1]]
+//   uint16_t runs[]					(run length - 1) << 5 | input code
+class InputRecording {
 public:
-	KeyboardInputs(int key_down, int key_left, int key_up, int key_right, int key_fire) :
-		key_down_(key_down), key_left_(key_left), key_up_(key_up), key_right_(key_right), key_fire_(key_fire)
-	{}
+	struct header_t {
+		char		magic[4];		// "W2IR"
+		uint16_t	version;
+		uint16_t	players;
+		uint32_t	ticks;			// Ticks recorded (for every player)
+		uint32_t	runs;			// Total runs, all players
+	};
 
-	void update(const ALLEGRO_EVENT& ev) override;
+	static constexpr uint16_t VERSION = 1;
+	static constexpr unsigned MAX_RUN = 1u << 11;		// Longest run a single entry can hold
+private:
+	std::vector<std::vector<uint16_t>>	runs_;		// Per player
+	tick_t								ticks_;
+public:
+	explicit InputRecording(size_t players = 1) : runs_(players), ticks_{ 0u } {}
+
+	// Append tick <tick>'s state of every controller (one per player).  Ticks must come in order,
+	// but may go back (after a rewind): the recording is cut back to <tick> first.
+	void record(tick_t tick, const std::vector<Inputs *>& controllers);
+
+	// Drop every tick from <tick> on
+	void truncate(tick_t tick);
+
+	bool save(const char *filename) const;
+	bool load(const char *filename);
+
+	size_t players() const { return runs_.size(); }
+	tick_t ticks() const { return ticks_; }
+	const std::vector<uint16_t>& runs(size_t player) const { return runs_.at(player); }
+	size_t file_bytes() const;
 };
+
+// Concrete Inputs subclass that plays one player's stream of an InputRecording back
+// (holding the last state once the recording runs out; the recording must outlive it)
+class ReplayInputs : public Inputs {
+	const std::vector<uint16_t>&	runs_;
+	size_t							run_;		// Run holding the current tick
+	tick_t							start_;		// First tick of run <run_>
+public:
+	ReplayInputs(const InputRecording& recording, size_t player) : runs_{ recording.runs(player) }, run_{ 0u }, start_{ 0u } {}
+
+	// Take on the recorded state for <tick> (call once per simulation tick; going backwards restarts the scan)
+	void seek(tick_t tick);
+};
\ No newline at end of file
@@ -1,5 +1,6 @@
 // Lib C stuff
 #include <cstdlib>
+#include <cstdio>
 #define _USE_MATH_DEFINES
 #include <cmath>
 
@@ -15,6 +16,8 @@
 #include <algorithm>
 #include <functional>
 #include <utility>
+#include <chrono>
+#include <cstring>
 
 // Raw Allegro 5 stuff
 #include <allegro5/allegro.h>
@@ -31,6 +34,14 @@ using namespace awful;
 #include "assets.h"		// Resource loading types
 #include "actors.h"		// Animation metadata types/tables
 #include "inputs.h"		// Input mechanism abstraction
+#include "ecs.h"		// Entity/component/system framework
+#include "timing.h"		// Fixed-timestep simulation clock
+#include "softrender.h"	// CPU renderer for indexed frames
+#include "capture.h"	// Asynchronous frame capture
+#include "audio.h"		// Software sound effect mixer
+#include "profile.h"	// Per-frame zone profiler
+#include "trace.h"		// Timeline tracing
+#include "memory.h"		// Heap accounting by subsystem
 
 // SETUP STUFF
 //---------------
@@ -44,18 +55,21 @@ static bool al_init_wrapper() {
 static const struct startup_t {
 	bool (*proc)();
 	const char *msg;
+	bool headless;		// Needed even when running without display/keyboard/sound?
 } startups[] = {
-	{ al_init_wrapper, "Initializing Allegro system..." },
-	{ al_install_keyboard, "Initializing keyboard subsystem..." },
-	{ al_install_mouse, "Initializing mouse subsystem..." },
-	{ al_install_audio, "Initializing audio subsystem..." },
-	{ al_init_font_addon, "Initializing font subsystem..." },
-	{ al_init_primitives_addon, "Initializing graphics primitives subsystem..." },
-	{ nullptr, nullptr }
+	{ al_init_wrapper, "Initializing Allegro system...", true },
+	{ al_install_keyboard, "Initializing keyboard subsystem...", false },
+	{ al_install_audio, "Initializing audio subsystem...", false },
+	{ al_init_font_addon, "Initializing font subsystem...", true },
+	{ al_init_primitives_addon, "Initializing graphics primitives subsystem...", true },
+	{ nullptr, nullptr, false }
 };
 
-void startup() {
+void startup(bool headless) {
+	TRACE_SCOPE("startup");
 	for (const startup_t *s = startups; s->proc != nullptr; ++s) {
+		if (headless && !s->headless) { continue; }
+		TRACE_SCOPE(s->msg);
 		std::cout << s->msg;
 		if (s->proc()) {
 			std::cout << "OK\n";
@@ -78,18 +92,146 @@ void allegro_die(const char *msg) {
 
 static constexpr int DWIDTH = 640, DHEIGHT = 400;
 
+// Simulation runs at a fixed rate; rendering runs at the frame pacer's cadence
+static constexpr double SIM_HZ = 64.0;
+static constexpr double RENDER_HZ = 60.0;
+
+// Debug overlay vertex budget: the profiler overlay (240 columns x 9 zones x 2) plus its key,
+// the HUD and sprite outlines for a full level all fit, with room to spare
+static constexpr size_t DEBUG_VERTICES = 16384;
+
+// Where F10 writes the profiler's frame history
+static constexpr const char *PROFILE_CSV = "profile.csv";
+
+// Most simulation ticks we will run to catch up in one go (beyond that, the game just runs slow)
+static constexpr unsigned MAX_CATCHUP_TICKS = 8;
+
+// Entity budget for a level (used to pre-size ECS pools so play never grows them)
+static constexpr size_t LEVEL_MAX_ENTITIES = 256;
+
+// Per-tick world snapshots kept for rewinding (and how far one press of BACKSPACE goes back)
+static constexpr size_t HISTORY_TICKS = 64 * 5;
+static constexpr tick_t REWIND_TICKS = 64;
+
+// Frames allowed to allocate (lazy driver/STL setup) before we start complaining about heap traffic
+static constexpr unsigned WARMUP_FRAMES = 8;
+
+// VGA-sized frame buffer that only repaints what changed since the last frame.
+// It is presented at the largest whole-number scale that fits the display (letterboxed), so
+// every VGA pixel becomes an exact square block.
+// Each frame's sprite batch is diffed against the previous one; the old and new bounds of every
+// sprite that moved, changed image or appeared/disappeared mark 16x16 tiles dirty, and only those
+// tiles are redrawn (static layers first, then the sprites overlapping them).  A frame with no
+// dirty tiles is skipped altogether--no redraw, no present.
 class RenderBuffer {
-	BitmapPtr fb_;
+	BitmapPtr					fb_;
+	BitmapPtr					scaled_;		// Display-scale copy (software renderer only)
+	DirtyTiles					dirty_;
+	std::vector<sprite_draw_t>	last_draws_;	// Last frame's batch, in entity order
+	unsigned long				repaints_, skips_;
+
+	void mark(const sprite_draw_t& d) {
+		dirty_.mark(d.x, d.y, float(al_get_bitmap_width(d.bitmap)), float(al_get_bitmap_height(d.bitmap)));
+	}
+
+	// A readable target is a memory bitmap already in FrameCapture's pixel format, so reading
+	// it back is a plain copy (locking a video bitmap would stall on the GPU every frame)
+	static ALLEGRO_BITMAP *create_target(bool readable) {
+		if (!readable) { return al_create_bitmap(VGA13_WIDTH, VGA13_HEIGHT); }
+		const int flags = al_get_new_bitmap_flags(), format = al_get_new_bitmap_format();
+		al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+		al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+		ALLEGRO_BITMAP *bmp = al_create_bitmap(VGA13_WIDTH, VGA13_HEIGHT);
+		al_set_new_bitmap_flags(flags);
+		al_set_new_bitmap_format(format);
+		return bmp;
+	}
 public:
-	RenderBuffer() : fb_(al_create_bitmap(VGA13_WIDTH, VGA13_HEIGHT)) {
+	// <readable>: frames will be read back on the CPU (--capture)
+	explicit RenderBuffer(bool readable = false) : fb_(create_target(readable)), repaints_{ 0u }, skips_{ 0u } {
 		if (!fb_) { throw std::exception("Unable to create RenderBuffer bitmap"); }
 		al_set_target_bitmap(fb_.get());
+		last_draws_.reserve(LEVEL_MAX_ENTITIES);
+		dirty_.mark_all();
 	}
 
+	// Repaint everything next frame (static layers rebuilt, display contents lost...)
+	void invalidate() { dirty_.mark_all(); }
+
+	// Mark whatever differs between <batch> and the previous frame's batch
+	void track(const SpriteBatch& batch) {
+		const sprite_draw_t *draws = batch.draws();
+		const size_t common = std::min(batch.size(), last_draws_.size());
+		for (size_t i = 0; i < common; ++i) {
+			if (draws[i] != last_draws_[i]) {
+				mark(last_draws_[i]);
+				mark(draws[i]);
+			}
+		}
+		for (size_t i = common; i < last_draws_.size(); ++i) { mark(last_draws_[i]); }
+		for (size_t i = common; i < batch.size(); ++i) { mark(draws[i]); }
+		last_draws_.assign(draws, draws + batch.size());
+	}
+
+	// Debug primitives are redrawn wherever they are now or were last frame
+	void track(const DebugDraw& debug) {
+		for (const DebugDraw::box_t& box : { debug.bounds(), debug.last_bounds() }) {
+			if (!box.empty()) { dirty_.mark(box.x0, box.y0, box.x1 - box.x0, box.y1 - box.y0); }
+		}
+	}
+
+	// Redraw the dirty regions, then the debug primitives on top (returns false--and draws
+	// nothing--if there are none)
+	bool repaint(StaticLayers& statics, SpriteBatch& batch, DebugDraw& debug) {
+		if (dirty_.empty()) {
+			debug.flush();		// (anything collected is entirely off-screen)
+			++skips_;
+			return false;
+		}
+
+		rect_t rects[DirtyTiles::MAX_RECTS];
+		const size_t count = dirty_.rects(rects);
+		for (size_t i = 0; i < count; ++i) {
+			al_set_clipping_rectangle(rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+			statics.draw();
+			batch.submit(&rects[i]);
+		}
+		al_reset_clipping_rectangle();
+		debug.flush();
+
+		dirty_.clear();
+		++repaints_;
+		return true;
+	}
+
+	ALLEGRO_BITMAP *bitmap() const { return fb_.get(); }
+
+	unsigned long repaints() const { return repaints_; }
+	unsigned long skips() const { return skips_; }
+
+	// Present the frame buffer (fb_ has no linear filtering flags, so scaling is nearest-neighbor)
 	void flip(ALLEGRO_DISPLAY *display) {
+		viewport_t view = integer_viewport(al_get_display_width(display), al_get_display_height(display));
+		al_set_target_backbuffer(display);
+		al_clear_to_color(al_map_rgb(0, 0, 0));
+		al_draw_scaled_bitmap(fb_.get(), 0, 0, VGA13_WIDTH, VGA13_HEIGHT, view.x, view.y, view.w, view.h, 0);
+		al_flip_display();
+		al_set_target_bitmap(fb_.get());
+	}
+
+	// Present <soft>'s frame instead: palette expansion, filtering and scaling happen on the CPU
+	// in one pass, straight into a display-sized bitmap that is then copied 1:1
+	void flip(ALLEGRO_DISPLAY *display, const SoftRenderer& soft, SCALE_FILTER filter) {
+		viewport_t view = integer_viewport(al_get_display_width(display), al_get_display_height(display));
+		if (!scaled_ || (al_get_bitmap_width(scaled_.get()) != view.w) || (al_get_bitmap_height(scaled_.get()) != view.h)) {
+			scaled_.reset(al_create_bitmap(view.w, view.h));
+			if (!scaled_) { throw std::exception("Unable to create RenderBuffer scaled bitmap"); }
+		}
+		soft.present(scaled_.get(), view.scale, filter);
+
 		al_set_target_backbuffer(display);
-		al_draw_scaled_bitmap(fb_.get(), 0, 0, VGA13_WIDTH, VGA13_HEIGHT, 0, 0,
-			al_get_display_width(display), al_get_display_height(display), 0);
+		al_clear_to_color(al_map_rgb(0, 0, 0));
+		al_draw_bitmap(scaled_.get(), view.x, view.y, 0);
 		al_flip_display();
 		al_set_target_bitmap(fb_.get());
 	}
@@ -228,356 +370,6 @@ private:
 };
 
 
-// Entity/Component/System experiments
-//------------------------------------------
-
-// Typedef and invalid value for an opaque entity ID
-using entity_id_t = unsigned int;
-constexpr entity_id_t INVALID_EID = 0u;
-
-// Typedef for global game clock
-using tick_t = unsigned int;
-
-// Typedef for bitmask telling what components are available for a given entity
-using component_mask_t = unsigned int;
-
-
-
-// Component base: contains the parent entity ID and operator< to sort the component based on that ID
-struct Component {
-	entity_id_t eid;
-
-	explicit Component(entity_id_t eid_) : eid{ eid_ } {}
-
-	bool operator<(const Component& that) const {
-		return eid < that.eid;
-	}
-};
-
-// Component: A basic sprite (screen position and rendering info)
-struct CSprite : public Component {
-	static constexpr component_mask_t Mask = 1;
-
-	ALLEGRO_BITMAP *bitmap;
-	float x, y;
-	int flags;		// Arbitrary flags used by rendering system to alter sprite's appearance
-
-	CSprite(entity_id_t eid_, ALLEGRO_BITMAP *bitmap_ = nullptr, float x_ = 0.0f, float y_ = 0.0f, int flags_ = 0) :
-		Component{ eid_ }, bitmap{ bitmap_}, x{ x_ }, y{ y_ }, flags{ flags_ } {}
-};
-
-// Component: Animation (metadata for a animating sprite)
-struct CAnimation : public Component {
-	static constexpr component_mask_t Mask = 2;
-
-	// Time base for frame selection (if any) and wobble (if any)
-	tick_t tbase;
-
-	// Animation frames (sequence of SpritesBin shapes and clock divider for frame rate)
-	sequence_t seq;
-	int rate;
-
-	// Palette effect (useful for enemies only)
-	ResourceBin::PALETTE pal;
-	
-	// "Wobble" on the y axis (to be implemented)
-	float wamp;	// max positive amplitude
-	int wper;	// period of an up/down cycle in frame ticks
-
-	CAnimation(entity_id_t eid_, sequence_t seq_ = nullptr, int rate_ = 1, ResourceBin::PALETTE pal_ = ResourceBin::PAL_DEFAULT, float wamp_ = 0.0f, int wper_ = 0) :
-		Component{ eid_ }, tbase{ 0u }, seq{ seq_ }, rate{ rate_ }, pal{ pal_ }, wamp{ wamp_ }, wper{ wper_ } {}
-
-};
-
-// Component: Actor (multi-direction/action animated model)
-struct CActor : public Component {
-	static constexpr component_mask_t Mask = 4;
-
-	actor_model_t *model;
-	ACTOR_DIRECTION dir;
-	ACTOR_ACTION action;
-
-	CActor(entity_id_t eid_, actor_model_t *model_ = nullptr, ACTOR_DIRECTION dir_ = DIR_DOWN, ACTOR_ACTION action_ = ACTION_IDLE) :
-		Component{ eid }, model { model_ }, dir{ dir_ }, action{ action_ } {}
-};
-
-enum class GridDirection {
-	Down = DIR_DOWN,
-	Left = DIR_LEFT,
-	Up = DIR_UP,
-	Right = DIR_RIGHT
-};
-
-std::pair<float, float> direction_delta(GridDirection dir, float scale = 1.0f) {
-	switch (dir) {
-	case GridDirection::Down:
-		return{ 0.f, scale };
-	case GridDirection::Left:
-		return{ -scale, 0.f };
-	case GridDirection::Up:
-		return{ 0.f, -scale };
-	case GridDirection::Right:
-		return{ scale, 0.f };
-	default:
-		return{ 0.f, 0.f };
-	}
-}
-
-// Component: Grid mover (dynamic entity whose movement is constrained by the 16x16 grid)
-struct CGridMover : public Component {
-	static constexpr component_mask_t Mask = 8;
-
-	bool moving;				// TRUE if the entity is moving
-	float dx, dy;				// Actual screen motion deltas
-	ACTOR_DIRECTION cur_dir;	// Actual facing direction of current movement (useful for Actors)
-
-	// Control intent indicators
-	bool			should_move;
-	GridDirection	move_dir;
-	float			move_scale;
-
-	CGridMover(entity_id_t eid_, bool moving_ = false, bool should_move_ = false, GridDirection move_dir_ = GridDirection::Down, float move_scale_ = 1.0f) :
-		Component{ eid_ }, moving{ moving_}, dx{ 0.0f }, dy{ 0.0f }, cur_dir{ (ACTOR_DIRECTION)move_dir_ },
-		should_move{ should_move_ }, move_dir{ move_dir_ }, move_scale{ move_scale_ } {}
-};
-
-// Component: "Hacks" component for general experimentation
-struct CHacks : public Component {
-	static constexpr component_mask_t Mask = 16;
-
-	bool wrap_to_screen;	// If true, wrap this [sprite-equipped] entity to the VGA screen
-	Inputs *controller;		// If !nullptr, use this to deduce the intent of our GridMoCtrl (if any)
-
-	CHacks(entity_id_t eid_, bool wrap_to_screen_ = false, Inputs *controller_ = nullptr) :
-		Component{ eid_ }, wrap_to_screen{ wrap_to_screen_ }, controller{ controller_ } {}
-};
-
-// Insert a component (by move-assignment) into a vector of that type of component,
-// keeping the vector sorted by entity ID (for fast binary search later)
-template<typename ComponentType, typename ContainerType = std::vector<ComponentType>>
-ComponentType& insert_component(ContainerType& container, ComponentType&& component) {
-	auto target = std::upper_bound(container.begin(), container.end(), component);
-	auto place = container.insert(target, component);
-	return *place;
-}
-
-// Look up a component of a given type from a container of the same by entity ID (using binary search)
-// If no matching component is found, returns nullptr
-template<typename ComponentType, typename ContainerType = std::vector<ComponentType>>
-ComponentType* lookup_component(ContainerType& container, entity_id_t eid) {
-	auto place = std::lower_bound(container.begin(), container.end(), component);
-	if ((place == container.end()) || (place->eid != eid)) {
-		return nullptr;
-	}
-	else {
-		return &*place;
-	}
-}
-
-// Compile-time-recursive foreach-tuple implementation inspired by (http://stackoverflow.com/questions/1198260/iterate-over-tuple/6894436#6894436)
-template<size_t Index, typename Func, typename... Pack>
-inline typename std::enable_if<Index == sizeof...(Pack)>::type tuple_foreach(std::tuple<Pack...> tup, Func fun) {} // Terminal case (no-op)
-
-template<size_t Index, typename Func, typename... Pack>
-inline typename std::enable_if<Index < sizeof...(Pack)>::type tuple_foreach(std::tuple<Pack...> tup, Func fun) {
-	fun(std::get<Index>(tup));							// Invoke payload...
-	tuple_foreach<Index + 1, Func, Pack...>(tup, fun);	// ...and recurse
-}
-
-
-// Advance an iterator-to-Component-collection until it hits the end or an entity ID >= the target
-// (Returns TRUE if it hit the target, FALSE otherwise)
-template<typename ComponentType, typename IteratorType = std::vector<ComponentType>::iterator>
-bool sync_iterator(entity_id_t eid, IteratorType& iter, const IteratorType& end) {
-	while ((iter != end) && (iter->eid < eid)) { ++iter; }
-	return (iter == end) ? false : (iter->eid == eid);
-}
-
-// An entity/component framework that supports a given list of component types (all subtypes of Component)
-template<typename... ComponentTypes>
-struct ECS {
-
-	struct Entity {
-		entity_id_t				id;		// Arbitrary/unique/opaque entity identifier
-		component_mask_t		cmask;	// Bitmask of what components this has
-		ECS<ComponentTypes...>&	sys;	// Reference back to parent system
-
-		Entity(ECS& parent, entity_id_t eid) : id{ eid }, cmask{ 0u }, sys{ parent } {}
-
-		bool has_all(component_mask_t mask) {
-			return (cmask & mask) == mask;
-		}
-
-		bool has_any(component_mask_t mask) {
-			return (cmask & mask);
-		}
-
-		// Construct and instance of type ComponentType with the given arguments and insert
-		// it into the corresponding vector-of-ComponenntType we have in our parent ECS system...
-		template<typename ComponentType, typename... Args>
-		Entity& add(Args&&... args) {
-			std::vector<ComponentType>& collection = std::get<std::vector<ComponentType>>(sys.components);
-			insert_component(collection, ComponentType{ id, std::forward<Args>(args)... });
-			cmask |= ComponentType::Mask;
-			return *this;
-		}
-	};
-
-	// This system's current max ID
-	entity_id_t eid_seed;
-
-	// The official game objects
-	std::vector<Entity> entities;
-
-	// And the vectors of components that make them up
-	std::tuple<std::vector<ComponentTypes>...> components;
-
-	ECS() : eid_seed { 0 } {}
-
-	// The entity list will always be sorted--we always add new entities at the back,
-	// and each new entity has an ID greater than all the previous ones (up until rollover--LOL)
-	Entity& make_entity() {
-		entities.emplace_back(*this, ++eid_seed);
-		return entities.back();
-	}
-
-	template<typename ComponentType>
-	std::vector<ComponentType>& get_components() {
-		return std::get<std::vector<ComponentType>>(components);
-	}
-
-	// TODO: use some magic template-fu to make a generic
-	// "iterate over all entities with X components and call
-	// this callable passing in references to those components"
-
-
-	// Drive user-control of grid movers
-	void sys_user_controls() {
-		std::vector<CGridMover>&	movers = get_components<CGridMover>();
-		std::vector<CHacks>&		hacks = get_components<CHacks>();
-
-		auto imover = movers.begin();
-		auto ihack = hacks.begin();
-
-		// For each entity...
-		for (Entity& e : entities) {
-			if (e.has_all(CGridMover::Mask | CHacks::Mask) && sync_iterator<CGridMover>(e.id, imover, movers.end()) && sync_iterator<CHacks>(e.id, ihack, hacks.end())) {
-				CGridMover& mover = *imover;
-				CHacks& hack = *ihack;
-
-				if (hack.controller) {
-					if (hack.controller->left()) {
-						mover.move_dir = GridDirection::Left;
-						mover.should_move = true;
-					}
-					else if (hack.controller->right()) {
-						mover.move_dir = GridDirection::Right;
-						mover.should_move = true;
-					}
-					else if (hack.controller->up()) {
-						mover.move_dir = GridDirection::Up;
-						mover.should_move = true;
-					}
-					else if (hack.controller->down()) {
-						mover.move_dir = GridDirection::Down;
-						mover.should_move = true;
-					}
-					else {
-						mover.should_move = false;
-					}
-				}
-			}
-		}
-	}
-
-	// Drive grid-locked motion
-	void sys_grid_moves() {
-		std::vector<CSprite>&		sprites = get_components<CSprite>();
-		std::vector<CGridMover>&	movers = get_components<CGridMover>();
-
-		auto isprite = sprites.begin();
-		auto imover = movers.begin();
-
-		// For each entity...
-		for (Entity& e : entities) {
-			if (e.has_all(CSprite::Mask | CGridMover::Mask) && sync_iterator<CSprite>(e.id, isprite, sprites.end()) && sync_iterator<CGridMover>(e.id, imover, movers.end())) {
-				CSprite& sprite = *isprite;
-				CGridMover& mover = *imover;
-
-				if (mover.moving) {
-					// Move!
-					sprite.x += mover.dx;
-					sprite.y += mover.dy;
-
-					// Have we entered a rest position?
-					if ((int(sprite.x) % 16 == 0) && (int(sprite.y) % 16 == 0)) {
-						// End busy mode (and stop moving)...
-						mover.moving = false;
-						mover.dx = mover.dy = 0.0f;
-					}
-				}
-				else {
-					// We are open to changing state
-					if (mover.should_move) {
-						mover.cur_dir = (ACTOR_DIRECTION)mover.move_dir;
-						std::tie(mover.dx, mover.dy) = direction_delta(mover.move_dir, mover.move_scale);
-						mover.moving = true;
-					}
-				}
-			}
-		}
-	}
-
-	// Sync grid motion with actor orientation/action
-	void sys_grid_actors() {
-
-	}
-
-	// Drive animations
-	void sys_animate(tick_t game_clock, const SpritesBin& sprite_data) {
-		auto& animats = get_components<CAnimation>();
-		auto& sprites = get_components<CSprite>();
-
-		auto ianimat = animats.begin();
-		auto isprite = sprites.begin();
-		
-		// For each entity...
-		for (Entity& e : entities) {
-			if (e.has_all(CAnimation::Mask | CSprite::Mask) && sync_iterator<CSprite>(e.id, isprite, sprites.end()) && sync_iterator<CAnimation>(e.id, ianimat, animats.end())) {
-				CSprite& sprite = *isprite;
-				CAnimation& animat = *ianimat;
-
-				// Update the SPRITE's bitmap based on the computed frame (and known palette) of ANIMATION
-				auto clock = (game_clock - animat.tbase) / animat.rate;
-				sprite.bitmap = sprite_data.sprite(compute_frame(animat.seq, clock), animat.pal);
-			}
-		}
-	}
-
-	// Walk all CSprite components and render them
-	void sys_render() {
-		for (CSprite& s : get_components<CSprite>()) {
-			if (s.bitmap) {
-				al_draw_bitmap(s.bitmap, s.x, s.y, 0);
-
-				// DEBUG HACKS
-				if (s.flags) {
-					unsigned char r = (s.flags & 4) ? 255 : 0;
-					unsigned char g = (s.flags & 2) ? 255 : 0;
-					unsigned char b = (s.flags & 1) ? 255 : 0;
-					al_draw_rectangle(
-						s.x + 0.5f,
-						s.y + 0.5f,
-						s.x + al_get_bitmap_width(s.bitmap),
-						s.y + al_get_bitmap_height(s.bitmap),
-						al_map_rgb(r, g, b), 1.0f);
-				}
-			}
-		}
-	}
-};
-
-
 /*void ECS::update(unsigned int interval) {
 	auto isprite = sprites.begin();
 	auto ishape = pal_shapes.begin();
@@ -721,44 +513,513 @@ void ECS::render() {
 }
 */
 
-int main(int argc, char **argv) {
-	startup();
+// One fixed-length step of the game simulation (everything except rendering)
+void simulate_tick(GameECS& ecs, tick_t game_clock, const std::vector<Inputs *>& controllers, Profiler& prof) {
+	TRACE_SCOPE("tick");
+	for (Inputs *ctrl : controllers) { ctrl->latch(); }
+	{ PROFILE_SCOPE(prof, ZONE_SNAPSHOT); TRACE_SCOPE("snapshot"); ecs.snapshot(game_clock); }
+	{ PROFILE_SCOPE(prof, ZONE_SAVE_POSITIONS); TRACE_SCOPE("save_positions"); ecs.sys_save_positions(); }
+	{ PROFILE_SCOPE(prof, ZONE_USER_CONTROLS); TRACE_SCOPE("user_controls"); ecs.sys_user_controls(controllers); }
+	{ PROFILE_SCOPE(prof, ZONE_GRID_MOVES); TRACE_SCOPE("grid_moves"); ecs.sys_grid_moves(); }
+	{ PROFILE_SCOPE(prof, ZONE_WRAP_POSITIONS); TRACE_SCOPE("wrap_positions"); ecs.sys_wrap_positions(); }
+	{ PROFILE_SCOPE(prof, ZONE_ANIMATE); TRACE_SCOPE("animate"); ecs.sys_animate(game_clock); }
+}
+
+// Static layer painter: the 16x16 gameplay grid (all lines in one primitive submission)
+void draw_grid_overlay() {
+	DebugDraw grid{ nullptr, 2 * ((VGA13_WIDTH / 16) + (VGA13_HEIGHT / 16) + 2) };
+	grid.enable(true);
+
+	for (float y = 0.5f; y < VGA13_HEIGHT; y += 16.0f) {
+		grid.line(0.5f, y, VGA13_WIDTH - 0.5f, y, al_map_rgba_f(0.5f, 0.5f, 0.5f, 0.25f));
+	}
+
+	for (float x = 0.5f; x < VGA13_WIDTH; x += 16.0f) {
+		grid.line(x, 0.5f, x, VGA13_HEIGHT - 0.5f, al_map_rgba_f(0.5f, 0.5f, 0.5f, 0.25f));
+	}
+	grid.flush();
+}
+
+// Draw whatever changed in the current scene into the RenderBuffer (<alpha> of the way between
+// the last two ticks); returns false if nothing did (so there is nothing new to present)
+// (<debug> may already hold primitives for this frame; sprite outlines are added to it)
+bool render_scene(GameECS& ecs, const ImageBank& images, StaticLayers& statics, RenderBuffer& frame_buff,
+	DebugDraw& debug, float alpha)
+{
+	MEMORY_TAG(MEM_RENDER);
+	SpriteBatch batch = ecs.sys_collect_sprites(images, alpha);
+	batch.debug_outlines(debug);
+
+	if (statics.dirty()) { frame_buff.invalidate(); }
+	frame_buff.track(batch);
+	frame_buff.track(debug);
+	return frame_buff.repaint(statics, batch, debug);
+}
+
+// Same, through the indexed software renderer (which always redraws the whole frame;
+// presenting it is up to the caller)
+bool render_scene_soft(GameECS& ecs, const ImageBank& images, SoftRenderer& soft, float alpha) {
+	MEMORY_TAG(MEM_RENDER);
+	SpriteBatch batch = ecs.sys_collect_sprites(images, alpha);
+
+	soft.draw_background();
+	soft.draw(batch);
+	return true;
+}
+
+// Populate the static layers with the demo scene's background (plus the grid overlay)
+void build_demo_statics(StaticLayers& statics, ALLEGRO_BITMAP *background) {
+	statics.add([background] { al_draw_bitmap(background, 0, 0, 0); });
+	statics.add(draw_grid_overlay);
+}
+
+// Sound effect played by the demo player on each grid step
+static constexpr sound_id_t DEMO_STEP_SOUND = 0;
+
+// Populate the ECS with the demo scene (the player-controlled entity listens to controller #0)
+void spawn_demo_level(GameECS& ecs) {
+	ecs.make_entity().add<CSprite>(NO_IMAGE, 16.f * 3, 16.f * 10, 2).add<CAnimation>(ANIM_WORM_RIGHT_MOVE, 8);
+	ecs.make_entity().add<CSprite>(ImageBank::sprite_id(207), 16.f * 10, 16.f * 6, 4)
+		.add<CGridMover>(false, false, GridDirection::Down, 1.0f, DEMO_STEP_SOUND).add<CHacks>(true, 0);
+}
+
+// Command-line options
+struct RunOptions {
+	bool headless;			// Run without display/keyboard/sound/timer?
+	tick_t ticks;			// (headless) Number of simulation ticks to run
+	const char *script;		// (headless) ScriptedInputs file driving controller #0 (or nullptr)
+	bool render;			// (headless) Also render every tick into a memory bitmap?
+	bool soft;				// Render through the indexed software renderer?
+	SCALE_FILTER filter;	// (soft) How to enlarge frames for the display
+	PRESENT_MODE present;	// Vsync policy
+	double fps;				// Target present cadence
+	bool paced;				// (headless) Render only when the pacer says so, on a virtual clock?
+	const char *capture;	// Record rendered frames to this file (or nullptr)
+	bool capture_hashes;	// ...and a per-frame hash list next to it?
+	const char *wav;		// (headless) Mix the session's sound effects into this WAV file (or nullptr)
+	const char *record;		// Save every tick's inputs to this InputRecording file (or nullptr)
+	const char *replay;		// Drive the player from this InputRecording file instead (or nullptr)
+	const char *trace;		// Write a Chrome trace-event timeline of the run to this file (or nullptr)
+	bool alloc_check;		// Fail when a frame allocates after warm-up (instead of just warning)?
+};
+
+static void usage(const char *argv0) {
+	std::cout << "usage: " << argv0 << " [--soft [--filter nearest|scale2x]] [--vsync off|on|triple] [--fps <hz>]"
+		" [--capture <file.y4m|file.ppm|file.raw> [--capture-hashes]]"
+		" [--record <file>] [--replay <file>] [--trace <file.json>] [--alloc-check]"
+		" [--headless <ticks> [--script <file>] [--render [--paced]] [--wav <file>]]\n"
+		"(--headless 0 --replay <file> runs for the length of the recording)\n"
+		"(--capture without --soft renders into a memory bitmap, so frames are copied, never read back from the GPU)\n";
+}
+
+static bool parse_args(int argc, char **argv, RunOptions& opts) {
+	opts = RunOptions{ false, 0u, nullptr, false, false, FILTER_NEAREST, PRESENT_VSYNC, RENDER_HZ, false, nullptr, false, nullptr, nullptr, nullptr, nullptr, false };
+	for (int i = 1; i < argc; ++i) {
+		if ((std::strcmp(argv[i], "--headless") == 0) && (i + 1 < argc)) {
+			opts.headless = true;
+			opts.ticks = static_cast<tick_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if ((std::strcmp(argv[i], "--script") == 0) && (i + 1 < argc)) {
+			opts.script = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--render") == 0) {
+			opts.render = true;
+		}
+		else if (std::strcmp(argv[i], "--soft") == 0) {
+			opts.soft = true;
+		}
+		else if ((std::strcmp(argv[i], "--vsync") == 0) && (i + 1 < argc)) {
+			const char *mode = argv[++i];
+			if (std::strcmp(mode, "off") == 0) { opts.present = PRESENT_IMMEDIATE; }
+			else if (std::strcmp(mode, "on") == 0) { opts.present = PRESENT_VSYNC; }
+			else if (std::strcmp(mode, "triple") == 0) { opts.present = PRESENT_TRIPLE; }
+			else { return false; }
+		}
+		else if ((std::strcmp(argv[i], "--fps") == 0) && (i + 1 < argc)) {
+			opts.fps = std::strtod(argv[++i], nullptr);
+			if (opts.fps <= 0.0) { return false; }
+		}
+		else if (std::strcmp(argv[i], "--paced") == 0) {
+			opts.paced = true;
+		}
+		else if ((std::strcmp(argv[i], "--capture") == 0) && (i + 1 < argc)) {
+			opts.capture = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--capture-hashes") == 0) {
+			opts.capture_hashes = true;
+		}
+		else if ((std::strcmp(argv[i], "--wav") == 0) && (i + 1 < argc)) {
+			opts.wav = argv[++i];
+		}
+		else if ((std::strcmp(argv[i], "--record") == 0) && (i + 1 < argc)) {
+			opts.record = argv[++i];
+		}
+		else if ((std::strcmp(argv[i], "--replay") == 0) && (i + 1 < argc)) {
+			opts.replay = argv[++i];
+		}
+		else if ((std::strcmp(argv[i], "--trace") == 0) && (i + 1 < argc)) {
+			opts.trace = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--alloc-check") == 0) {
+			opts.alloc_check = true;
+		}
+		else if ((std::strcmp(argv[i], "--filter") == 0) && (i + 1 < argc)) {
+			const char *name = argv[++i];
+			if (std::strcmp(name, "scale2x") == 0) {
+				opts.filter = FILTER_SCALE2X;
+			}
+			else if (std::strcmp(name, "nearest") == 0) {
+				opts.filter = FILTER_NEAREST;
+			}
+			else {
+				return false;
+			}
+		}
+		else {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Frame pacing summary (milliseconds)
+static void print_pacing(const FramePacer& pacer) {
+	static const char *PHASE_NAMES[FramePacer::PHASE_COUNT] = { "simulate", "render", "present" };
+	auto line = [](const char *name, const FrameStats& stats) {
+		std::cout << "  " << name << ": mean " << (stats.mean() * 1e3) << " ms, p99 " << (stats.p99() * 1e3)
+			<< " ms, jitter " << (stats.jitter() * 1e3) << " ms\n";
+	};
+
+	std::cout << pacer.frames() << " frames presented (" << pacer.missed() << " slots missed), last "
+		<< FrameStats::WINDOW << " frames:\n";
+	for (size_t p = 0; p < FramePacer::PHASE_COUNT; ++p) {
+		line(PHASE_NAMES[p], pacer.phase(static_cast<FramePacer::PHASE>(p)));
+	}
+	line("interval", pacer.intervals());
+	line("lateness", pacer.lateness());
+}
+
+// Input latency summary (milliseconds)
+static void print_latency(const InputLatency& latency) {
+	auto line = [](const char *name, const LatencyHistogram& h) {
+		std::cout << "  " << name << ": " << h.count() << " samples, mean " << (h.mean() * 1e3) << " ms, p50 <"
+			<< (h.percentile(50.0) * 1e3) << " ms, p99 <" << (h.percentile(99.0) * 1e3) << " ms, max " << (h.max() * 1e3) << " ms\n";
+	};
+
+	std::cout << latency.inputs() << " input changes (" << latency.coalesced() << " coalesced into an earlier one's tick):\n";
+	line("input to tick", latency.to_tick());
+	line("tick to present", latency.tick_to_present());
+	line("input to present", latency.to_present());
+}
+
+// Queue the frame just rendered for capture (indexed when the software renderer made it)
+static void capture_frame(FrameCapture& capture, const SoftRenderer *soft, const RenderBuffer& frame_buff) {
+	if (soft) {
+		capture.push(soft->frame(), soft->palette());
+	}
+	else {
+		capture.push(frame_buff.bitmap());
+	}
+}
+
+// Load --replay's recording (or report why not)
+static bool load_replay(const char *filename, InputRecording& recording) {
+	if (!recording.load(filename)) {
+		std::cout << "Unable to load input recording " << filename << "\n";
+		return false;
+	}
+	std::cout << "replaying " << recording.ticks() << " ticks from " << filename << "\n";
+	return true;
+}
+
+static void save_recording(const char *filename, const InputRecording& recording) {
+	if (recording.save(filename)) {
+		std::cout << "recorded " << recording.ticks() << " ticks of input into " << recording.file_bytes() << " bytes\n";
+	}
+	else {
+		std::cout << "Unable to save input recording " << filename << "\n";
+	}
+}
+
+static void write_trace(const char *filename) {
+	if (Trace::write(filename)) {
+		std::cout << "wrote trace to " << filename << " (" << Trace::dropped() << " events dropped)\n";
+	}
+	else {
+		std::cout << "Unable to write trace " << filename << "\n";
+	}
+}
+
+// Complain about a steady-state frame that allocated (or give up, with --alloc-check)
+static void check_frame_allocs(FrameAllocCheck& check, bool fatal) {
+	size_t made = check.end_frame();
+	if (!made) { return; }
+
+	std::cout << "WARNING: frame " << check.frames() << " made " << made << " heap allocation(s)";
+	if (MemoryStats::hooked()) {
+		const char *sep = " (";
+		for (size_t t = 0; t < MEM_TAG_COUNT; ++t) {
+			if (!check.allocs(MEM_TAG(t))) { continue; }
+			std::cout << sep << MemoryStats::NAMES[t] << ' ' << check.allocs(MEM_TAG(t));
+			sep = ", ";
+		}
+		std::cout << ")\n";
+	}
+	else {
+		std::cout << " in ECS pools (raise LEVEL_MAX_ENTITIES?)\n";
+	}
+	if (fatal) { throw std::exception("Heap allocation in a steady-state frame"); }
+}
+
+// Resident bytes by subsystem (plus what Allegro holds for the assets, which the hooks can't see)
+static void print_memory(const ResourceBin& rsrc, const SpritesBin& sprites, const FrameAllocCheck& check) {
+	if (MemoryStats::hooked()) {
+		std::cout << "heap by subsystem (resident bytes, allocations, bytes requested):\n";
+		for (size_t t = 0; t < MEM_TAG_COUNT; ++t) {
+			mem_counts_t c = MemoryStats::tag(MEM_TAG(t));
+			std::cout << "  " << MemoryStats::NAMES[t] << ": " << c.resident << ", " << c.allocs << ", " << c.bytes << "\n";
+		}
+		std::cout << "  total resident: " << MemoryStats::total().resident << "\n";
+	}
+	else {
+		std::cout << "heap hooks not built in (define W2DIR_HEAP_HOOKS); ECS pools: " << g_pool_heap.allocs
+			<< " allocations, " << g_pool_heap.bytes << " bytes\n";
+	}
+	std::cout << "  RESOURCE.BIN data: " << rsrc.data_bytes() << " bytes" << (MemoryStats::hooked() ? " (in assets above)" : "") << "\n";
+	std::cout << "  sprite sheet bitmaps (Allegro): " << sprites.bitmap_bytes() << " bytes\n";
+	std::cout << "  steady-state frames that allocated: " << check.violations() << " (of " << check.frames() << ")\n";
+}
+
+static void print_capture(const FrameCapture& capture) {
+	std::cout << "captured " << capture.pushed() << " frames (" << capture.dropped() << " dropped: writer fell behind)\n";
+}
+
+// (only once the audio thread is gone)
+static void print_mixer(const Mixer& mixer, const SoundCoalescer& coalescer, const SoundChannel& channel) {
+	std::cout << channel.emitted() << " sound events (" << channel.overflowed() << " overflowed, " << coalescer.merged()
+		<< " merged, " << coalescer.capped() << " capped), played " << mixer.played() << " sounds on " << mixer.voices()
+		<< " voices (" << mixer.stolen() << " stolen, " << mixer.rejected() << " rejected)\n";
+}
+
+static void print_audio_thread(const AudioThread& audio) {
+	std::cout << "audio thread: " << audio.sent() << " commands (" << audio.dropped() << " dropped, max depth "
+		<< audio.max_depth() << "), " << audio.fragments() << " fragments mixed, " << audio.underruns() << " underruns\n";
+}
+
+// Indexed software renderer for the demo scene (TITLE.BIN behind the sprites)
+std::unique_ptr<SoftRenderer> make_soft_renderer(const ResourceBin& rsrc, const SpritesBin& sprites) {
+	Buffer title;
+	if (!bload_file("TITLE.BIN", title)) { throw std::exception("Unable to load BSAVED data from disk"); }
+	return std::unique_ptr<SoftRenderer>(new SoftRenderer{ sprites, title, rsrc.menu_palette(),
+		rsrc.game_palette(ResourceBin::PAL_DEFAULT) });
+}
+
+// Drive the simulation as fast as possible with no display, keyboard, sound, or timer
+// (inputs come from a script), then report throughput and per-system cost
+int run_headless(const RunOptions& opts) {
+	// Without a display, every bitmap has to live in system memory
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+
+	Trace::begin("load assets");
+	ResourceBin rsrc{ "RESOURCE.BIN" };
+	SpritesBin sprites{ rsrc, "SPRITES.BIN" };
+	BitmapPtr bgrd{ bload_image("TITLE.BIN", rsrc.menu_palette()) };
+	Trace::end("load assets");
+
+	MemoryTag::set(MEM_OTHER);
+	ScriptedInputs script;
+	if (opts.script && !script.load(opts.script)) {
+		std::cout << "Unable to load input script " << opts.script << "\n";
+		return 1;
+	}
 
+	MemoryTag::set(MEM_ECS);
+	GameECS ecs;
+	ecs.reserve(LEVEL_MAX_ENTITIES);
+	ecs.reserve_history(HISTORY_TICKS);
+	MemoryTag::set(MEM_OTHER);
+
+	InputRecording replay_data, recording;
+	std::unique_ptr<ReplayInputs> replay;
+	if (opts.replay) {
+		if (!load_replay(opts.replay, replay_data)) { return 1; }
+		replay.reset(new ReplayInputs{ replay_data, 0 });
+	}
+	const tick_t ticks = (opts.replay && !opts.ticks) ? replay_data.ticks() : opts.ticks;
+
+	MemoryTag::set(MEM_RENDER);
+	ImageBank images{ sprites };
+	std::vector<Inputs *> controllers{ replay ? static_cast<Inputs *>(replay.get()) : &script };
+	{
+		MEMORY_TAG(MEM_ECS);
+		spawn_demo_level(ecs);
+	}
+
+	std::unique_ptr<RenderBuffer> frame_buff;
+	std::unique_ptr<StaticLayers> statics;
+	std::unique_ptr<SoftRenderer> soft;
+	DebugDraw debug;		// (never enabled)
+	if (opts.render) {
+		frame_buff.reset(new RenderBuffer{ opts.capture != nullptr });
+		statics.reset(new StaticLayers());
+		build_demo_statics(*statics, bgrd.get());
+		if (opts.soft) { soft = make_soft_renderer(rsrc, sprites); }
+	}
+
+	// With --paced, frames are scheduled on virtual time (ticks / SIM_HZ), so which ticks get
+	// rendered is exactly reproducible
+	double virtual_now = 0.0;
+	FramePacer pacer{ opts.fps, PRESENT_IMMEDIATE, [&virtual_now] { return virtual_now; } };
+
+	// (unpaced, every tick is a frame, so the capture runs at the simulation rate)
+	std::unique_ptr<FrameCapture> capture;
+	if (opts.capture && frame_buff) {
+		const double capture_fps = opts.paced ? opts.fps : SIM_HZ;
+		capture.reset(new FrameCapture{ opts.capture, int(capture_fps + 0.5), opts.capture_hashes });
+	}
+
+	// Sound is mixed offline, in step with the ticks, if asked for
+	std::unique_ptr<Mixer> mixer;
+	std::unique_ptr<SoundCoalescer> coalescer;
+	std::unique_ptr<WavRenderer> wav;
+	MemoryTag::set(MEM_AUDIO);
+	if (opts.wav) {
+		mixer.reset(new Mixer{ rsrc });
+		coalescer.reset(new SoundCoalescer{ rsrc.num_sounds() });
+		wav.reset(new WavRenderer{ opts.wav, *mixer, *coalescer, unsigned(SIM_HZ) });
+	}
+
+	MemoryTag::set(MEM_OTHER);
+
+	Profiler profiler{ true };
+	FrameAllocCheck alloc_check{ WARMUP_FRAMES };
+	auto start = std::chrono::steady_clock::now();
+	for (tick_t game_clock = 0u; game_clock < ticks; ++game_clock) {
+		script.seek(game_clock);
+		if (replay) { replay->seek(game_clock); }
+		if (opts.record) { recording.record(game_clock, controllers); }
+		simulate_tick(ecs, game_clock, controllers, profiler);
+		if (wav) {
+			wav->tick(ecs.sounds, game_clock);
+		}
+		else {
+			ecs.sounds.clear();
+		}
+		virtual_now = (game_clock + 1) / SIM_HZ;
+		if (frame_buff && (!opts.paced || pacer.frame_due())) {
+			TRACE_SCOPE("frame");
+			if (soft) {
+				{ PROFILE_SCOPE(profiler, ZONE_RENDER); TRACE_SCOPE("render"); render_scene_soft(ecs, images, *soft, 1.0f); }
+				{ PROFILE_SCOPE(profiler, ZONE_PRESENT); TRACE_SCOPE("present"); soft->present(frame_buff->bitmap()); }
+			}
+			else {
+				PROFILE_SCOPE(profiler, ZONE_RENDER);
+				TRACE_SCOPE("render");
+				render_scene(ecs, images, *statics, *frame_buff, debug, 1.0f);
+			}
+			pacer.presented();
+			if (capture) { capture_frame(*capture, soft.get(), *frame_buff); }
+		}
+		ecs.end_frame();
+		profiler.end_frame();
+		check_frame_allocs(alloc_check, opts.alloc_check);
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << ticks << " ticks in " << elapsed << " s ("
+		<< ((elapsed > 0.0) ? (ticks / elapsed) : 0.0) << " ticks/s)\n";
+	for (size_t z = 0; z < ZONE_COUNT; ++z) {
+		if ((z == ZONE_EVENTS) || ((z == ZONE_PRESENT) && !soft)) { continue; }		// (nothing to time)
+		std::cout << "  " << Profiler::NAMES[z] << ": "
+			<< (ticks ? (profiler.total(PROFILE_ZONE(z)) * 1e6 / ticks) : 0.0) << " us/tick\n";
+	}
+	if (opts.paced) {
+		print_pacing(pacer);
+	}
+	if (wav) {
+		std::cout << "mixed " << wav->frames() << " frames in " << wav->mix_seconds() << " s ("
+			<< ((wav->mix_seconds() > 0.0) ? (wav->frames() / wav->mix_seconds()) : 0.0) << " frames/s, "
+			<< ((wav->mix_seconds() > 0.0) ? (wav->frames() / (wav->mix_seconds() * MIX_RATE)) : 0.0) << "x real time)\n";
+		print_mixer(*mixer, *coalescer, ecs.sounds);
+	}
+	if (capture) {
+		print_capture(*capture);
+	}
+	if (opts.record) {
+		save_recording(opts.record, recording);
+	}
+	if (soft) {
+		std::cout << "  final frame checksum: " << std::hex << soft->checksum() << std::dec << "\n";
+	}
+	else if (frame_buff) {
+		std::cout << "  frames repainted: " << frame_buff->repaints() << " (" << frame_buff->skips() << " unchanged)\n";
+	}
+	print_memory(rsrc, sprites, alloc_check);
+	return 0;
+}
+
+// Normal (windowed, real-time) game
+int run_interactive(const RunOptions& opts) {
 	EventQueuePtr events{ al_create_event_queue() };
 	if (!events) { allegro_die("Unable to create event queue"); }
-	al_register_event_source(events.get(), al_get_keyboard_event_source());
-	al_register_event_source(events.get(), al_get_mouse_event_source());
+	al_register_event_source(events.get(), al_get_keyboard_event_source());		// (no mouse: nothing uses it)
 
-	TimerPtr timer{ al_create_timer(1.0 / 64) };
-	if (!timer) { allegro_die("Unable to create timer"); }
-	al_register_event_source(events.get(), al_get_timer_event_source(timer.get()));
-	
 	//al_set_new_display_flags(ALLEGRO_FULLSCREEN);
+	al_set_new_display_option(ALLEGRO_VSYNC, (opts.present == PRESENT_IMMEDIATE) ? 2 : 1, ALLEGRO_SUGGEST);
 	DisplayPtr dptr{ al_create_display(DWIDTH, DHEIGHT) };
 	if (!dptr) { allegro_die("Unable to create display"); }
 	al_register_event_source(events.get(), al_get_display_event_source(dptr.get()));
 
 	// Load assets
+	Trace::begin("load assets");
 	ResourceBin rsrc{ "RESOURCE.BIN" };
 	SpritesBin sprites{ rsrc, "SPRITES.BIN" };
 
-	if (!al_reserve_samples(rsrc.num_sounds())) { allegro_die("Failed to reserve samples"); }
-	
+	// Sound effects go through our own mixer (a fixed voice pool), run by its own thread
+	MemoryTag::set(MEM_AUDIO);
+	Mixer mixer{ rsrc };
+	SoundCoalescer coalescer{ rsrc.num_sounds() };
+	std::unique_ptr<AudioThread> audio{ new AudioThread{ mixer, coalescer } };
+	MemoryTag::set(MEM_OTHER);
+
 	BitmapPtr bgrd{ bload_image("TITLE.BIN", rsrc.menu_palette()) };
 	if (!bgrd) { allegro_die("Unable to BLOAD TITLE.BIN"); }
+	Trace::end("load assets");
 
-	KeyboardInputs ctrl{ ALLEGRO_KEY_DOWN, ALLEGRO_KEY_LEFT, ALLEGRO_KEY_UP, ALLEGRO_KEY_RIGHT, ALLEGRO_KEY_SPACE };
+	KeyboardInputs keyboard{ 1 };
+	keyboard.bind(0, ALLEGRO_KEY_DOWN, ALLEGRO_KEY_LEFT, ALLEGRO_KEY_UP, ALLEGRO_KEY_RIGHT, ALLEGRO_KEY_SPACE);
 
 	/*Animation figure{ ANIMATION_TABLE[ANIM_BUBBLE_NA_SHOOT], 10 };
 	Actor cuby{ MODEL_TABLE[ACTOR_CUBY], 6 };
 	Position spot{ VGA13_WIDTH / 2, VGA13_HEIGHT / 2, 1 };*/
 
 	// Create an E/C manager for our given component types
-	ECS<CSprite, CAnimation, CActor, CGridMover, CHacks> ecs;
+	MemoryTag::set(MEM_ECS);
+	GameECS ecs;
+	ecs.reserve(LEVEL_MAX_ENTITIES);
+	ecs.reserve_history(HISTORY_TICKS);
+	MemoryTag::set(MEM_OTHER);
+
+	// Inputs can be recorded as they're used, or come from a recording instead of the keyboard
+	InputRecording replay_data, recording;
+	std::unique_ptr<ReplayInputs> replay;
+	if (opts.replay) {
+		if (!load_replay(opts.replay, replay_data)) { return 1; }
+		replay.reset(new ReplayInputs{ replay_data, 0 });
+	}
+
+	// Components refer to bitmaps and controllers by handle/index
+	MemoryTag::set(MEM_RENDER);
+	ImageBank images{ sprites };
+	std::vector<Inputs *> controllers{ replay ? static_cast<Inputs *>(replay.get()) : &keyboard.player(0) };
+	{
+		MEMORY_TAG(MEM_ECS);
+		spawn_demo_level(ecs);
+	}
 
-	ecs.make_entity().add<CSprite>(bgrd.get());
-	ecs.make_entity().add<CSprite>(nullptr, 16.f * 3, 16.f * 10, 2).add<CAnimation>(ANIMATION_TABLE[ANIM_WORM_RIGHT_MOVE], 8);
-	ecs.make_entity().add<CSprite>(sprites.sprite(207), 16.f * 10, 16.f * 6, 4).add<CGridMover>().add<CHacks>(true, &ctrl);
+	// Background and grid never change: composite them once
+	StaticLayers statics;
+	build_demo_statics(statics, bgrd.get());
 
 
 	//ecs.make_entity().add_sprite(16.0f * 10, 16.0f * 6, sprites.sprite(207), 7).add_motion().add_grid_mo_ctrl().add_hack(true, &ctrl);
@@ -772,146 +1033,247 @@ int main(int argc, char **argv) {
 	// Try to make Cuby!
 	//auto cuby_id = ecs.make_entity().add_sprite().add_motion(nullptr, 4u).add_grid_mo_ctrl().add_timer().add_hack(true, &ctrl, &MODEL_TABLE[ACTOR_CUBY]).id;
 
-	RenderBuffer frame_buff;	// All rendering goes here...
-	al_start_timer(timer.get());
+	RenderBuffer frame_buff{ opts.capture != nullptr };	// All rendering goes here...
+	std::unique_ptr<SoftRenderer> soft;
+	if (opts.soft) { soft = make_soft_renderer(rsrc, sprites); }
+	FixedStep stepper{ SIM_HZ, MAX_CATCHUP_TICKS, al_get_time() };
+	FramePacer pacer{ opts.fps, opts.present, al_get_time };
+	InputLatency latency;
+	Profiler profiler;			// Per-zone frame times (F11 toggles; F10 dumps them to PROFILE_CSV)
+	// Sprite outlines and HUD text (F12 toggles; off by default, since the HUD's tick counter
+	// changes every frame and so would repaint every frame)
+	DebugDraw debug{ &rsrc, DEBUG_VERTICES };
+	std::unique_ptr<FrameCapture> capture;
+	if (opts.capture) { capture.reset(new FrameCapture{ opts.capture, int(opts.fps + 0.5), opts.capture_hashes }); }
+	MemoryTag::set(MEM_OTHER);
+	FrameAllocCheck alloc_check{ WARMUP_FRAMES };
 	bool done = false;
 	bool render = true;
 	tick_t game_clock = 0u;
 
 	//ResourceBin::PALETTE pal = ResourceBin::PAL_DEFAULT;
 	while (!done) {
+		// Sleep until the next event or the next frame, whichever comes first, then take every
+		// event that's waiting (a burst of events is handled in one pass, never one per frame)
 		ALLEGRO_EVENT evt;
-		al_wait_for_event(events.get(), &evt);
-
-		// Update controller status based on event
-		ctrl.update(evt);
-		
-		switch (evt.type) {
-		case ALLEGRO_EVENT_DISPLAY_CLOSE:
-			done = true;
-			break;
-		case ALLEGRO_EVENT_KEY_DOWN:
-			switch (evt.keyboard.keycode) {
-			case ALLEGRO_KEY_ESCAPE:
+		for (bool got = al_wait_for_event_timed(events.get(), &evt, float(pacer.time_to_due())); got;
+			got = al_get_next_event(events.get(), &evt)) {
+			PROFILE_SCOPE(profiler, ZONE_EVENTS);
+			TRACE_SCOPE("events");
+
+			// Update controller status based on event (only the state at the next tick counts;
+			// while replaying, no tick reads the keyboard, so its presses aren't latency samples)
+			if (keyboard.update(evt) && !replay) { latency.input(evt.any.timestamp); }
+
+			switch (evt.type) {
+			case ALLEGRO_EVENT_DISPLAY_CLOSE:
 				done = true;
 				break;
-			/*case ALLEGRO_KEY_F1:
-				cuby.set_model(MODEL_TABLE[ACTOR_CUBY], 6);
-				break;
-			case ALLEGRO_KEY_F2:
-				cuby.set_model(MODEL_TABLE[ACTOR_COBY], 6);
-				break;
-			case ALLEGRO_KEY_F3:
-				cuby.set_model(MODEL_TABLE[ACTOR_BEE], 3);
-				break;
-			case ALLEGRO_KEY_F4:
-				cuby.set_model(MODEL_TABLE[ACTOR_WORM], 3);
-				break;
-			case ALLEGRO_KEY_F5:
-				cuby.set_model(MODEL_TABLE[ACTOR_SHARK], 6);
-				break;
-			case ALLEGRO_KEY_F6:
-				cuby.set_model(MODEL_TABLE[ACTOR_GHOST], 3);
-				break;
-			case ALLEGRO_KEY_F7:
-				cuby.set_model(MODEL_TABLE[ACTOR_PUTTY], 6);
-				break;
-			case ALLEGRO_KEY_F8:
-				cuby.set_model(MODEL_TABLE[ACTOR_MOUSE], 6);
-				break;
-			case ALLEGRO_KEY_F9:
-				cuby.set_model(MODEL_TABLE[ACTOR_PENGUIN], 6);
-				break;
-			case ALLEGRO_KEY_PGUP:
-				break;
-			case ALLEGRO_KEY_PGDN:
-				break;*/
-			}
-			break;
-		case ALLEGRO_EVENT_KEY_CHAR:
-			switch (evt.keyboard.unichar) {
-			case '0':
-				//ecs.pal = ResourceBin::PAL_DEFAULT;
-				render = true;
-				break;
-			case '1':
-				//ecs.pal = ResourceBin::PAL_RED_ENEMIES;
-				render = true;
-				break;
-			case '2':
-				//ecs.pal = ResourceBin::PAL_BLUE_ENEMIES;
+			case ALLEGRO_EVENT_DISPLAY_EXPOSE:
+			case ALLEGRO_EVENT_DISPLAY_SWITCH_IN:
+				// The window contents may be gone: repaint and present everything
+				frame_buff.invalidate();
 				render = true;
 				break;
-			case '3':
-				//ecs.pal = ResourceBin::PAL_DIM_ENEMIES;
-				render = true;
+			case ALLEGRO_EVENT_KEY_DOWN:
+				switch (evt.keyboard.keycode) {
+				case ALLEGRO_KEY_ESCAPE:
+					done = true;
+					break;
+				case ALLEGRO_KEY_F12:
+					debug.toggle();
+					render = true;
+					break;
+				case ALLEGRO_KEY_F11:
+					profiler.toggle();
+					render = true;
+					break;
+				case ALLEGRO_KEY_F10:
+					if (profiler.dump_csv(PROFILE_CSV)) {
+						std::cout << "wrote the last " << std::min(profiler.frames(), Profiler::FRAMES) << " frames to " << PROFILE_CSV << "\n";
+					}
+					break;
+				case ALLEGRO_KEY_BACKSPACE:
+					// Rewind (as far as our history allows)
+					if (ecs.history.size()) {
+						tick_t target = (game_clock > REWIND_TICKS) ? (game_clock - REWIND_TICKS) : 0u;
+						target = std::max(target, ecs.history.oldest_tick());
+						if (ecs.restore(target) || ecs.restore(target = ecs.history.oldest_tick())) {
+							game_clock = target;
+						}
+					}
+					break;
+				/*case ALLEGRO_KEY_F1:
+					cuby.set_model(MODEL_TABLE[ACTOR_CUBY], 6);
+					break;
+				case ALLEGRO_KEY_F2:
+					cuby.set_model(MODEL_TABLE[ACTOR_COBY], 6);
+					break;
+				case ALLEGRO_KEY_F3:
+					cuby.set_model(MODEL_TABLE[ACTOR_BEE], 3);
+					break;
+				case ALLEGRO_KEY_F4:
+					cuby.set_model(MODEL_TABLE[ACTOR_WORM], 3);
+					break;
+				case ALLEGRO_KEY_F5:
+					cuby.set_model(MODEL_TABLE[ACTOR_SHARK], 6);
+					break;
+				case ALLEGRO_KEY_F6:
+					cuby.set_model(MODEL_TABLE[ACTOR_GHOST], 3);
+					break;
+				case ALLEGRO_KEY_F7:
+					cuby.set_model(MODEL_TABLE[ACTOR_PUTTY], 6);
+					break;
+				case ALLEGRO_KEY_F8:
+					cuby.set_model(MODEL_TABLE[ACTOR_MOUSE], 6);
+					break;
+				case ALLEGRO_KEY_F9:
+					cuby.set_model(MODEL_TABLE[ACTOR_PENGUIN], 6);
+					break;
+				case ALLEGRO_KEY_PGUP:
+					break;
+				case ALLEGRO_KEY_PGDN:
+					break;*/
+				}
 				break;
-			case 'a':	// 0
-			case 'b':	// 1
-			case 'c':	// 2
-			case 'd':	// 3
-			case 'e':	// 4
-			case 'f':	// 5
-			case 'g':	// 6
-			case 'h':	// 7
-			case 'i':	// 8
-			case 'j':	// 9
-			case 'k':	// 10
-			case 'l':	// 11
-			case 'm':	// 12
-			case 'n':	// 13
-			case 'o':	// 14
-			case 'p':	// 15
-			case 'q':	// 16
-			case 'r':	// 17
-			case 's':	// 18
-				al_play_sample(rsrc.sound_sample(evt.keyboard.unichar - 'a'),
-					1.0f, ALLEGRO_AUDIO_PAN_NONE, 1.0f, ALLEGRO_PLAYMODE_ONCE, nullptr);
+			case ALLEGRO_EVENT_KEY_CHAR:
+				switch (evt.keyboard.unichar) {
+				case '0':
+					//ecs.pal = ResourceBin::PAL_DEFAULT;
+					if (soft) { soft->set_palette(rsrc.game_palette(ResourceBin::PAL_DEFAULT)); }
+					render = true;
+					break;
+				case '1':
+					//ecs.pal = ResourceBin::PAL_RED_ENEMIES;
+					if (soft) { soft->set_palette(rsrc.game_palette(ResourceBin::PAL_RED_ENEMIES)); }
+					render = true;
+					break;
+				case '2':
+					//ecs.pal = ResourceBin::PAL_BLUE_ENEMIES;
+					if (soft) { soft->set_palette(rsrc.game_palette(ResourceBin::PAL_BLUE_ENEMIES)); }
+					render = true;
+					break;
+				case '3':
+					//ecs.pal = ResourceBin::PAL_DIM_ENEMIES;
+					if (soft) { soft->set_palette(rsrc.game_palette(ResourceBin::PAL_DIM_ENEMIES)); }
+					render = true;
+					break;
+				case 'a':	// 0
+				case 'b':	// 1
+				case 'c':	// 2
+				case 'd':	// 3
+				case 'e':	// 4
+				case 'f':	// 5
+				case 'g':	// 6
+				case 'h':	// 7
+				case 'i':	// 8
+				case 'j':	// 9
+				case 'k':	// 10
+				case 'l':	// 11
+				case 'm':	// 12
+				case 'n':	// 13
+				case 'o':	// 14
+				case 'p':	// 15
+				case 'q':	// 16
+				case 'r':	// 17
+				case 's':	// 18
+					ecs.sounds.emit(evt.keyboard.unichar - 'a', VGA13_WIDTH / 2);
+					break;
+				}
 				break;
 			}
-			break;
-		case ALLEGRO_EVENT_TIMER:
-			if (evt.timer.source == timer.get()) {
-				++game_clock;
-				render = true;
-			}
-			break;
 		}
 
-		if (render && al_is_event_queue_empty(events.get())) {
-			// "Control"
-			//cuby.set_from_inputs(ctrl);
-			//spot.set_delta_from_inputs(ctrl);
-
-			// "Physics"
-			//spot.update();
-			//ecs.update();
-
-			// "Render"
-			
-			//al_draw_bitmap(sprites.sprite(cuby.shape_advance(), pal), spot.x, spot.y, 0);
-			//al_draw_bitmap(sprites.sprite(figure.shape_advance(), pal), 0, 0, 0);
-
-			//ecs.render();
-
-			ecs.sys_user_controls();
-			ecs.sys_grid_moves();
-			ecs.sys_animate(game_clock, sprites);
-			ecs.sys_render();
-			
-
-			for (float y = 0.5f; y < VGA13_HEIGHT; y += 16.0f) {
-				al_draw_line(0.5f, y, VGA13_WIDTH - 0.5f, y, al_map_rgba_f(0.5f, 0.5f, 0.5f, 0.25f), 1.0f);
+		// Run every simulation tick owed by the wall clock (regardless of how busy the
+		// event queue is), so game speed never depends on event or render load
+		pacer.begin(FramePacer::SIMULATE);
+		for (unsigned ticks = stepper.advance(al_get_time()); ticks > 0; --ticks) {
+			latency.consumed(al_get_time());
+			if (replay) { replay->seek(game_clock); }
+			if (opts.record) { recording.record(game_clock, controllers); }
+			simulate_tick(ecs, game_clock, controllers, profiler);
+			audio->submit(ecs.sounds, game_clock);
+			++game_clock;
+		}
+		pacer.end(FramePacer::SIMULATE);
+
+		// (events that arrived since the drain wait for the next pass; they don't hold up the frame)
+		if (render || pacer.frame_due()) {
+			TRACE_SCOPE("frame");
+			bool changed = true;
+			pacer.begin(FramePacer::RENDER);
+			if (soft) {
+				PROFILE_SCOPE(profiler, ZONE_RENDER);
+				TRACE_SCOPE("render");
+				render_scene_soft(ecs, images, *soft, stepper.alpha());
 			}
-
-			for (float x = 0.5f; x < VGA13_WIDTH; x += 16.0f) {
-				al_draw_line(x, 0.5f, x, VGA13_HEIGHT - 0.5f, al_map_rgba_f(0.5f, 0.5f, 0.5f, 0.25f), 1.0f);
+			else {
+				PROFILE_SCOPE(profiler, ZONE_RENDER);
+				TRACE_SCOPE("render");
+				if (debug.enabled()) {
+					char hud[64];
+					std::snprintf(hud, sizeof(hud), "TICK %u  DROPPED %lu", game_clock, stepper.dropped());
+					debug.text(2.0f, 2.0f, al_map_rgb(255, 255, 255), hud);
+					if (profiler.enabled()) { profiler.overlay(debug, 1.0 / opts.fps); }
+				}
+				changed = render_scene(ecs, images, statics, frame_buff, debug, stepper.alpha());
 			}
+			pacer.end(FramePacer::RENDER);
 
-			frame_buff.flip(dptr.get());
+			pacer.begin(FramePacer::PRESENT);
+			if (soft) {
+				PROFILE_SCOPE(profiler, ZONE_PRESENT);
+				TRACE_SCOPE("present");
+				frame_buff.flip(dptr.get(), *soft, opts.filter);
+			}
+			else if (changed) {
+				PROFILE_SCOPE(profiler, ZONE_PRESENT);
+				TRACE_SCOPE("present");
+				frame_buff.flip(dptr.get());
+			}
+			pacer.end(FramePacer::PRESENT);
+			const bool flipped = soft || changed;
+			pacer.presented(flipped);		// (always: it schedules the next slot)
+			if (flipped) { latency.presented(al_get_time()); }		// (only a real flip shows an input's effect)
 			render = false;
+
+			// (every presented frame, changed or not, so the recording keeps real time)
+			if (capture) { capture_frame(*capture, soft.get(), frame_buff); }
+
+			// Steady-state frames should never have to allocate
+			ecs.end_frame();
+			profiler.end_frame();
+			if (Trace::enabled()) {
+				Trace::counter("audio queue", double(audio->depth()));
+				Trace::counter("heap allocs", double(MemoryStats::hooked() ? MemoryStats::total().allocs : g_pool_heap.allocs));
+			}
+			check_frame_allocs(alloc_check, opts.alloc_check);
 		}
 	}
 
+	print_pacing(pacer);
+	print_latency(latency);
+	if (debug.dropped()) { std::cout << "debug overlay dropped " << debug.dropped() << " lines (raise DEBUG_VERTICES)\n"; }
+	if (capture) { print_capture(*capture); }
+	if (opts.record) { save_recording(opts.record, recording); }
+	print_audio_thread(*audio);
+	audio.reset();
+	print_mixer(mixer, coalescer, ecs.sounds);
+	print_memory(rsrc, sprites, alloc_check);
 	return 0;
 }
+
+int main(int argc, char **argv) {
+	RunOptions opts;
+	if (!parse_args(argc, argv, opts)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// (every other thread is gone by the time run_*() returns, so the trace can be written then)
+	if (opts.trace) { Trace::start(); }
+	startup(opts.headless);
+	int status = opts.headless ? run_headless(opts) : run_interactive(opts);
+	if (opts.trace) { write_trace(opts.trace); }
+	return status;
+}
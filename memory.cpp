@@ -0,0 +1,142 @@
+// Heap accounting by subsystem
+//------------------------------
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "arena.h"
+#include "memory.h"
+
+namespace {
+	thread_local MEM_TAG t_tag = MEM_OTHER;
+
+#ifdef W2DIR_HEAP_HOOKS
+	struct tag_counters_t {
+		std::atomic<size_t>	allocs, frees, bytes, resident;
+	};
+	tag_counters_t g_tags[MEM_TAG_COUNT];
+	thread_local size_t t_allocs[MEM_TAG_COUNT];		// This thread's share of g_tags[].allocs
+
+	// Prefix of every hooked block (keeps the user pointer aligned like malloc's)
+	struct block_header_t {
+		size_t		size;
+		MEM_TAG		tag;
+	};
+	constexpr size_t HEADER_BYTES = (sizeof(block_header_t) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+	void *hooked_alloc(size_t size) noexcept {
+		auto *head = static_cast<block_header_t *>(std::malloc(HEADER_BYTES + size));
+		if (!head) { return nullptr; }
+		head->size = size;
+		head->tag = t_tag;
+
+		tag_counters_t& c = g_tags[head->tag];
+		c.allocs.fetch_add(1u, std::memory_order_relaxed);
+		c.bytes.fetch_add(size, std::memory_order_relaxed);
+		c.resident.fetch_add(size, std::memory_order_relaxed);
+		++t_allocs[head->tag];
+		return reinterpret_cast<uint8_t *>(head) + HEADER_BYTES;
+	}
+
+	void hooked_free(void *p) noexcept {
+		if (!p) { return; }
+		auto *head = reinterpret_cast<block_header_t *>(static_cast<uint8_t *>(p) - HEADER_BYTES);
+
+		// (charged to the tag it was allocated under, whoever frees it)
+		tag_counters_t& c = g_tags[head->tag];
+		c.frees.fetch_add(1u, std::memory_order_relaxed);
+		c.resident.fetch_sub(head->size, std::memory_order_relaxed);
+		std::free(head);
+	}
+
+	void *hooked_new(size_t size) {
+		void *p = hooked_alloc(size);
+		if (!p) { throw std::bad_alloc(); }
+		return p;
+	}
+#endif
+}
+
+#ifdef W2DIR_HEAP_HOOKS
+// Replacement global allocation functions (the over-aligned forms are left to the library)
+void *operator new(size_t size) { return hooked_new(size); }
+void *operator new[](size_t size) { return hooked_new(size); }
+void *operator new(size_t size, const std::nothrow_t&) noexcept { return hooked_alloc(size); }
+void *operator new[](size_t size, const std::nothrow_t&) noexcept { return hooked_alloc(size); }
+void operator delete(void *p) noexcept { hooked_free(p); }
+void operator delete[](void *p) noexcept { hooked_free(p); }
+void operator delete(void *p, size_t) noexcept { hooked_free(p); }
+void operator delete[](void *p, size_t) noexcept { hooked_free(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept { hooked_free(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { hooked_free(p); }
+#endif
+
+const char *const MemoryStats::NAMES[MEM_TAG_COUNT] = { "other", "assets", "ecs", "audio", "render" };
+
+bool MemoryStats::hooked() {
+#ifdef W2DIR_HEAP_HOOKS
+	return true;
+#else
+	return false;
+#endif
+}
+
+mem_counts_t MemoryStats::tag(MEM_TAG tag) {
+#ifdef W2DIR_HEAP_HOOKS
+	const tag_counters_t& c = g_tags[tag];
+	return mem_counts_t{ c.allocs.load(), c.frees.load(), c.bytes.load(), c.resident.load() };
+#else
+	(void)tag;
+	return mem_counts_t{ 0u, 0u, 0u, 0u };
+#endif
+}
+
+size_t MemoryStats::thread_allocs(MEM_TAG tag) {
+#ifdef W2DIR_HEAP_HOOKS
+	return t_allocs[tag];
+#else
+	(void)tag;
+	return 0u;
+#endif
+}
+
+mem_counts_t MemoryStats::total() {
+	mem_counts_t sum{ 0u, 0u, 0u, 0u };
+	for (size_t t = 0; t < MEM_TAG_COUNT; ++t) { sum += tag(MEM_TAG(t)); }
+	return sum;
+}
+
+MEM_TAG MemoryTag::set(MEM_TAG tag) {
+	MEM_TAG prev = t_tag;
+	t_tag = tag;
+	return prev;
+}
+
+MEM_TAG MemoryTag::current() {
+	return t_tag;
+}
+
+FrameAllocCheck::FrameAllocCheck(unsigned warmup) : warmup_{ warmup }, frames_{ 0u }, pool_seen_{ g_pool_heap.allocs }, violations_{ 0u } {
+	for (size_t t = 0; t < MEM_TAG_COUNT; ++t) {
+		seen_[t] = MemoryStats::thread_allocs(MEM_TAG(t));
+		frame_[t] = 0u;
+	}
+}
+
+size_t FrameAllocCheck::end_frame() {
+	size_t made = g_pool_heap.allocs - pool_seen_;
+	pool_seen_ = g_pool_heap.allocs;
+	if (MemoryStats::hooked()) {
+		made = 0u;		// (pool trips are heap allocations too, so they're in the tags already)
+		for (size_t t = 0; t < MEM_TAG_COUNT; ++t) {
+			size_t now = MemoryStats::thread_allocs(MEM_TAG(t));
+			frame_[t] = now - seen_[t];
+			seen_[t] = now;
+			made += frame_[t];
+		}
+	}
+
+	if ((++frames_ <= warmup_) || (made == 0u)) { return 0u; }
+	++violations_;
+	return made;
+}
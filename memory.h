@@ -0,0 +1,94 @@
+#pragma once
+#ifndef W2DIR_MEMORY_H
+#define W2DIR_MEMORY_H
+// Heap accounting by subsystem
+//------------------------------
+
+#include <cstddef>
+
+#include "common.h"
+
+// Who an allocation is charged to
+enum MEM_TAG {
+	MEM_OTHER,
+	MEM_ASSETS,
+	MEM_ECS,
+	MEM_AUDIO,
+	MEM_RENDER,
+	MEM_TAG_COUNT
+};
+
+// Totals for one tag (or all of them)
+struct mem_counts_t {
+	size_t allocs;		// operator new calls
+	size_t frees;		// operator delete calls
+	size_t bytes;		// Total bytes ever requested
+	size_t resident;	// Bytes allocated and not yet freed
+
+	mem_counts_t& operator+=(const mem_counts_t& o) {
+		allocs += o.allocs; frees += o.frees; bytes += o.bytes; resident += o.resident;
+		return *this;
+	}
+};
+
+// Built with W2DIR_HEAP_HOOKS, memory.cpp replaces the global operator new/delete with versions
+// that charge every allocation to the calling thread's current tag (a small header in front of
+// each block remembers the size and tag for the delete).  Without it, tags cost one
+// thread-local store and every count reads zero.
+//
+// Only C++ heap traffic is seen: Allegro allocates its bitmaps, samples, etc. with malloc (see
+// SpritesBin::bitmap_bytes() for the biggest of those, the sprite sheets).
+class MemoryStats {
+public:
+	static const char *const NAMES[MEM_TAG_COUNT];
+
+	static bool hooked();		// Built with W2DIR_HEAP_HOOKS?
+
+	static mem_counts_t tag(MEM_TAG tag);
+	static mem_counts_t total();
+
+	// Allocations charged to <tag> by the calling thread alone
+	static size_t thread_allocs(MEM_TAG tag);
+};
+
+// Charges the calling thread's allocations to <tag> until the end of the enclosing scope.
+// set() does the same without a scope, for straight-line setup code (returns the old tag).
+class MemoryTag {
+	MEM_TAG		prev_;
+public:
+	explicit MemoryTag(MEM_TAG tag) : prev_{ set(tag) } {}
+	~MemoryTag() { set(prev_); }
+
+	MemoryTag(const MemoryTag&) = delete;
+	MemoryTag& operator=(const MemoryTag&) = delete;
+
+	static MEM_TAG set(MEM_TAG tag);
+	static MEM_TAG current();
+};
+
+#define MEMORY_TAG(tag) MemoryTag W2DIR_CONCAT(memory_tag_, __LINE__){ tag }
+
+// Counts a frame's heap allocations: all of the calling thread's when the hooks are built in
+// (worker threads such as the audio thread and capture writer aren't part of the frame), otherwise
+// only the ECS pool trips (g_pool_heap).  The first <warmup> frames are allowed to allocate
+// (lazy driver/STL setup); after that, any allocation is a steady-state violation.  Create it
+// and call end_frame() on the game thread.
+class FrameAllocCheck {
+	unsigned		warmup_, frames_;
+	size_t			pool_seen_;					// g_pool_heap.allocs at the end of the last frame
+	size_t			seen_[MEM_TAG_COUNT];		// Per-tag allocs at the end of the last frame
+	size_t			frame_[MEM_TAG_COUNT];		// ...made during the last frame
+	unsigned long	violations_;
+public:
+	explicit FrameAllocCheck(unsigned warmup);
+
+	// Close a frame; returns its allocation count if the frame is past warm-up and allocated
+	// (the per-tag breakdown is then in allocs(tag)), else 0
+	size_t end_frame();
+
+	size_t allocs(MEM_TAG tag) const { return frame_[tag]; }	// Last frame's allocations charged to <tag> (hooks only)
+	unsigned frames() const { return frames_; }
+	unsigned long violations() const { return violations_; }
+};
+
+#endif
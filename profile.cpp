@@ -0,0 +1,78 @@
+// Per-frame zone profiler
+//-------------------------
+#include <algorithm>
+#include <fstream>
+
+#include "profile.h"
+
+// Overlay scale (vertical pixels per millisecond of frame time)
+static constexpr float OVERLAY_PX_PER_MS = 2.0f;
+
+constexpr size_t Profiler::FRAMES;
+
+const char *const Profiler::NAMES[ZONE_COUNT] = {
+	"events", "snapshot", "save_positions", "user_controls", "grid_moves", "wrap_positions", "animate", "render", "present"
+};
+
+Profiler::Profiler(bool enabled) : enabled_{ enabled }, frames_{ 0u } {
+	current_.fill(0.0);
+	totals_.fill(0.0);
+}
+
+void Profiler::end_frame() {
+	if (!enabled_) { return; }
+
+	frame_t& f = ring_[frames_ % FRAMES];
+	for (size_t z = 0; z < ZONE_COUNT; ++z) {
+		f[z] = static_cast<float>(current_[z]);
+		totals_[z] += current_[z];
+	}
+	current_.fill(0.0);
+	++frames_;
+}
+
+bool Profiler::dump_csv(const char *filename) const {
+	std::ofstream out{ filename };
+	if (!out) { return false; }
+
+	out << "frame";
+	for (const char *name : NAMES) { out << ',' << name; }
+	out << '\n';
+
+	const size_t count = std::min(frames_, FRAMES);
+	for (size_t age = count; age-- > 0;) {
+		out << (frames_ - 1 - age);
+		for (float seconds : frame(age)) { out << ',' << (seconds * 1e3f); }
+		out << '\n';
+	}
+	return bool(out);
+}
+
+void Profiler::overlay(DebugDraw& debug, double frame_seconds) const {
+	static const ALLEGRO_COLOR colors[ZONE_COUNT] = {
+		al_map_rgb(255, 255, 255), al_map_rgb(128, 128, 128), al_map_rgb(0, 128, 255), al_map_rgb(0, 255, 255),
+		al_map_rgb(0, 255, 0), al_map_rgb(128, 255, 0), al_map_rgb(255, 255, 0), al_map_rgb(255, 128, 0),
+		al_map_rgb(255, 0, 255)
+	};
+	const float base = VGA13_HEIGHT - 0.5f;
+
+	const size_t count = std::min(frames_, FRAMES);
+	for (size_t age = 0; age < count; ++age) {
+		const float x = (VGA13_WIDTH - 0.5f) - age;
+		float y = base;
+		for (size_t z = 0; (z < ZONE_COUNT) && (y > 0.0f); ++z) {
+			float h = frame(age)[z] * 1e3f * OVERLAY_PX_PER_MS;
+			if (h < 0.5f) { continue; }
+			float top = std::max(y - h, 0.0f);
+			debug.line(x, y, x, top, colors[z]);
+			y = top;
+		}
+	}
+
+	const float budget = base - float(frame_seconds * 1e3 * OVERLAY_PX_PER_MS);
+	debug.line(VGA13_WIDTH - float(FRAMES), budget, float(VGA13_WIDTH), budget, al_map_rgb(255, 0, 0));
+
+	for (size_t z = 0; z < ZONE_COUNT; ++z) {
+		debug.text(2.0f, float(VGA13_HEIGHT - ((ZONE_COUNT - z) * 8)), colors[z], NAMES[z]);
+	}
+}
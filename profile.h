@@ -0,0 +1,97 @@
+#pragma once
+#ifndef W2DIR_PROFILE_H
+#define W2DIR_PROFILE_H
+// Per-frame zone profiler
+//-------------------------
+
+#include <array>
+#include <chrono>
+
+#include "common.h"
+#include "render.h"
+
+// What the frame time is spent on
+enum PROFILE_ZONE {
+	ZONE_EVENTS,
+	ZONE_SNAPSHOT,
+	ZONE_SAVE_POSITIONS,
+	ZONE_USER_CONTROLS,
+	ZONE_GRID_MOVES,
+	ZONE_WRAP_POSITIONS,
+	ZONE_ANIMATE,
+	ZONE_RENDER,
+	ZONE_PRESENT,
+	ZONE_COUNT
+};
+
+// Collects the time spent in each zone (see PROFILE_SCOPE) over a frame, keeps the last
+// FRAMES frames in a ring, and whole-run totals.  While disabled, nothing is timed.
+class Profiler {
+public:
+	using clock = std::chrono::steady_clock;
+	using frame_t = std::array<float, ZONE_COUNT>;		// Seconds per zone
+
+	static constexpr size_t FRAMES = 240;
+	static const char *const NAMES[ZONE_COUNT];
+private:
+	bool							enabled_;
+	std::array<double, ZONE_COUNT>	current_, totals_;
+	std::array<frame_t, FRAMES>		ring_;
+	size_t							frames_;			// Frames ended so far (the ring holds the last FRAMES)
+public:
+	explicit Profiler(bool enabled = false);
+
+	bool enabled() const { return enabled_; }
+	void enable(bool on) { enabled_ = on; }
+	void toggle() { enabled_ = !enabled_; }
+
+	void add(PROFILE_ZONE zone, clock::duration elapsed) {
+		current_[zone] += std::chrono::duration<double>(elapsed).count();
+	}
+
+	// Close the current frame's sample (no-op while disabled)
+	void end_frame();
+
+	size_t frames() const { return frames_; }
+	double total(PROFILE_ZONE zone) const { return totals_[zone]; }
+
+	// <age> frames before the last one ended (0 is the latest; must be < min(frames(), FRAMES))
+	const frame_t& frame(size_t age) const { return ring_[(frames_ - 1 - age) % FRAMES]; }
+
+	// Write the ring (oldest first) as CSV, one row per frame, milliseconds per zone
+	bool dump_csv(const char *filename) const;
+
+	// Stacked bar per frame (newest on the right) along the bottom edge of the screen, with a
+	// line at one <frame_seconds> budget and a color key
+	void overlay(DebugDraw& debug, double frame_seconds) const;
+};
+
+// Charges the time until the end of the enclosing scope to <zone>.  Disabled, the only cost
+// is the enabled() test (its result is carried to the destructor in <prof_>).
+class ProfileScope {
+	Profiler			*prof_;
+	PROFILE_ZONE		zone_;
+	Profiler::clock::time_point	start_;
+public:
+	ProfileScope(Profiler& prof, PROFILE_ZONE zone) : prof_{ nullptr }, zone_{ zone } {
+		if (prof.enabled()) {
+			prof_ = &prof;
+			start_ = Profiler::clock::now();
+		}
+	}
+	~ProfileScope() {
+		if (prof_) { prof_->add(zone_, Profiler::clock::now() - start_); }
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+// Build with W2DIR_NO_PROFILER to compile every scope out entirely
+#ifndef W2DIR_NO_PROFILER
+#define PROFILE_SCOPE(prof, zone) ProfileScope W2DIR_CONCAT(profile_scope_, __LINE__){ (prof), (zone) }
+#else
+#define PROFILE_SCOPE(prof, zone) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,201 @@
+// Rendering helpers: cached static layers and sprite batching
+//--------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+#include <allegro5/allegro_primitives.h>
+
+#include "render.h"
+
+StaticLayers::StaticLayers() :
+	cache_{ al_create_bitmap(VGA13_WIDTH, VGA13_HEIGHT) }, dirty_{ true }, rebuilds_{ 0u }
+{
+	if (!cache_) { throw std::exception("Unable to create StaticLayers cache bitmap"); }
+}
+
+void StaticLayers::draw() {
+	if (dirty_) {
+		awful::TempTargetBitmap target{ cache_.get() };
+		al_clear_to_color(al_map_rgb(0, 0, 0));
+		for (auto& paint : painters_) {
+			paint();
+		}
+		dirty_ = false;
+		++rebuilds_;
+	}
+
+	// The cache is opaque and covers the whole target, so copy it without blending
+	int op, src, dst;
+	al_get_blender(&op, &src, &dst);
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+	al_draw_bitmap(cache_.get(), 0, 0, 0);
+	al_set_blender(op, src, dst);
+}
+
+void SpriteBatch::sort() {
+	// Stable LSD radix sort, 8 bits per pass, ping-ponging between two arena arrays
+	sprite_draw_t *src = draws_;
+	sprite_draw_t *dst = arena_.alloc_array<sprite_draw_t>(count_);
+	sprite_draw_t *spare = nullptr;
+	size_t counts[256];
+
+	for (unsigned shift = 0; shift < 32; shift += 8) {
+		for (size_t& c : counts) { c = 0u; }
+		for (size_t i = 0; i < count_; ++i) { ++counts[(src[i].key >> shift) & 0xFFu]; }
+
+		// Every key has the same byte here: this pass wouldn't move anything
+		if ((count_ == 0) || (counts[(src[0].key >> shift) & 0xFFu] == count_)) { continue; }
+
+		size_t start = 0;
+		for (size_t& c : counts) {
+			size_t n = c;
+			c = start;
+			start += n;
+		}
+		for (size_t i = 0; i < count_; ++i) {
+			dst[counts[(src[i].key >> shift) & 0xFFu]++] = src[i];
+		}
+
+		// The submission-order array must survive (it's what RenderBuffer diffs against)
+		if (src == draws_) {
+			if (!spare) { spare = arena_.alloc_array<sprite_draw_t>(count_); }
+			src = dst;
+			dst = spare;
+		}
+		else {
+			std::swap(src, dst);
+		}
+	}
+
+	sorted_ = src;
+}
+
+size_t SpriteBatch::submit(const rect_t *clip) {
+	ordered();
+
+	// Submit in one held-drawing section (Allegro flushes whenever the atlas changes)
+	groups_ = 0u;
+	int last_atlas = -1;
+	al_hold_bitmap_drawing(true);
+	for (size_t i = 0; i < count_; ++i) {
+		const sprite_draw_t& d = sorted_[i];
+		if (clip && !clip->overlaps(d.x, d.y, float(al_get_bitmap_width(d.bitmap)), float(al_get_bitmap_height(d.bitmap)))) {
+			continue;
+		}
+		if (int(d.key & 0xFFu) != last_atlas) {
+			last_atlas = int(d.key & 0xFFu);
+			++groups_;
+		}
+		al_draw_bitmap(d.bitmap, d.x, d.y, 0);
+	}
+	al_hold_bitmap_drawing(false);
+
+	return groups_;
+}
+
+void SpriteBatch::debug_outlines(DebugDraw& debug) const {
+	if (!debug.enabled()) { return; }
+	for (size_t i = 0; i < count_; ++i) {
+		const sprite_draw_t& d = draws_[i];
+		if (d.flags) {
+			unsigned char r = (d.flags & 4) ? 255 : 0;
+			unsigned char g = (d.flags & 2) ? 255 : 0;
+			unsigned char b = (d.flags & 1) ? 255 : 0;
+			debug.rect(d.x, d.y, d.x + al_get_bitmap_width(d.bitmap), d.y + al_get_bitmap_height(d.bitmap), al_map_rgb(r, g, b));
+		}
+	}
+}
+
+void DebugDraw::text(float x, float y, ALLEGRO_COLOR color, const char *str) {
+	if (!enabled_ || !font_) { return; }
+	for (; *str; ++str, x += 8.0f) {
+		const uint8_t *glyph = font_->font_glyph(static_cast<unsigned char>(*str));
+		if (!glyph) { continue; }
+		for (int row = 0; row < 8; ++row) {
+			uint8_t bits = glyph[row];
+			for (int col = 0; col < 8;) {
+				if (!(bits & (0x80u >> col))) {
+					++col;
+					continue;
+				}
+				int end = col;
+				while ((end < 8) && (bits & (0x80u >> end))) { ++end; }
+				line(x + col, y + row + 0.5f, x + end, y + row + 0.5f, color);
+				col = end;
+			}
+		}
+	}
+}
+
+size_t DebugDraw::flush() {
+	size_t count = verts_.size();
+	if (count) {
+		al_draw_prim(verts_.data(), nullptr, nullptr, 0, int(count), ALLEGRO_PRIM_LINE_LIST);
+	}
+	verts_.clear();
+	last_bounds_ = bounds_;
+	bounds_ = no_box();
+	return count;
+}
+
+viewport_t integer_viewport(int display_width, int display_height) {
+	int scale = std::max(1, std::min(display_width / int(VGA13_WIDTH), display_height / int(VGA13_HEIGHT)));
+	int w = int(VGA13_WIDTH) * scale, h = int(VGA13_HEIGHT) * scale;
+	return viewport_t{ scale, (display_width - w) / 2, (display_height - h) / 2, w, h };
+}
+
+size_t cull_to_screen(const float *x, const float *y, const float *w, const float *h, size_t count, uint8_t *visible) {
+	const float sw = float(VGA13_WIDTH), sh = float(VGA13_HEIGHT);
+	size_t shown = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uint8_t v = uint8_t((x[i] < sw) & (x[i] + w[i] > 0.0f) & (y[i] < sh) & (y[i] + h[i] > 0.0f));
+		visible[i] = v;
+		shown += v;
+	}
+	return shown;
+}
+
+void DirtyTiles::mark(float x, float y, float w, float h) {
+	// Pad by a pixel: interpolated positions are fractional, and debug outlines reach the edge
+	int c0 = std::max(0, int(std::floor(x - 1.0f)) / TILE);
+	int r0 = std::max(0, int(std::floor(y - 1.0f)) / TILE);
+	int c1 = std::min(COLS - 1, int(std::ceil(x + w + 1.0f)) / TILE);
+	int r1 = std::min(ROWS - 1, int(std::ceil(y + h + 1.0f)) / TILE);
+	if ((c0 > c1) || (r0 > r1) || (x + w + 1.0f < 0.0f) || (y + h + 1.0f < 0.0f)) { return; }
+
+	uint32_t bits = ((c1 - c0 == 31) ? ~0u : ((1u << (c1 - c0 + 1)) - 1u)) << c0;
+	for (int r = r0; r <= r1; ++r) {
+		rows_[r] |= bits;
+	}
+}
+
+size_t DirtyTiles::rects(rect_t *out) const {
+	size_t count = 0;
+	for (int r = 0; r < ROWS; ++r) {
+		const uint32_t bits = rows_[r];
+		int c = 0;
+		while ((c < COLS) && (bits >> c)) {
+			// Find the next run of dirty tiles [c, e)
+			while (!((bits >> c) & 1u)) { ++c; }
+			int e = c;
+			while ((e < COLS) && ((bits >> e) & 1u)) { ++e; }
+
+			// Grow a rectangle that ended on the row above with exactly the same span, or start a new one
+			rect_t span{ c * TILE, r * TILE, (e - c) * TILE, TILE };
+			size_t i = 0;
+			while ((i < count) && !((out[i].x == span.x) && (out[i].w == span.w) && (out[i].y + out[i].h == span.y))) { ++i; }
+			if (i < count) {
+				out[i].h += TILE;
+			}
+			else {
+				out[count++] = span;
+			}
+			c = e;
+		}
+	}
+
+	// The bottom row of tiles hangs off the screen
+	for (size_t i = 0; i < count; ++i) {
+		out[i].h = std::min(out[i].h, int(VGA13_HEIGHT) - out[i].y);
+	}
+	return count;
+}
@@ -0,0 +1,253 @@
+#pragma once
+#ifndef W2DIR_RENDER_H
+#define W2DIR_RENDER_H
+// Rendering helpers: cached static layers and sprite batching
+//--------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_primitives.h>
+
+#include "awful.h"
+#include "common.h"
+#include "assets.h"
+#include "arena.h"
+
+// Stack of static content (background, grid overlay, level tiles...) pre-composited into one
+// cached VGA-sized bitmap.  Painters run (in the order added) only when the cache has been
+// invalidated; every other frame, draw() is a single opaque blit no matter how much is in the stack.
+class StaticLayers {
+	awful::BitmapPtr					cache_;
+	std::vector<std::function<void()>>	painters_;	// Each draws one layer to the current target
+	bool								dirty_;
+	unsigned							rebuilds_;	// How many times the cache has been re-composited
+public:
+	StaticLayers();
+
+	// Append a layer (drawn above all previous ones); invalidates the cache
+	void add(std::function<void()> painter) {
+		painters_.push_back(std::move(painter));
+		dirty_ = true;
+	}
+
+	// Call whenever the content behind any painter changes
+	void invalidate() { dirty_ = true; }
+
+	// Will the next draw() re-composite (i.e., has everything behind the sprites changed)?
+	bool dirty() const { return dirty_; }
+
+	// Re-composite (if needed), then copy the cache to the current target
+	void draw();
+
+	unsigned rebuilds() const { return rebuilds_; }
+};
+
+// Draw layers (lower layers are drawn first, i.e., underneath)
+enum SPRITE_LAYER : uint8_t {
+	LAYER_BACKGROUND,
+	LAYER_ACTORS,		// Depth-sorted: sprites lower on the screen are drawn in front
+	LAYER_EFFECTS,
+	LAYER_MAX
+};
+
+// Packed 32-bit draw order key: layer (bits 24-31), then depth (bits 8-23), then atlas (bits 0-7).
+// Only depth-sorted layers get a depth; in the others every sprite of an atlas sorts together
+// (so the whole layer is one run per atlas).
+inline uint32_t sprite_sort_key(SPRITE_LAYER layer, float y, uint8_t atlas) {
+	uint32_t depth = 0u;
+	if (layer == LAYER_ACTORS) {
+		// Biased so sprites partly above the screen still sort correctly
+		depth = static_cast<uint32_t>(std::min(std::max(int(std::floor(y)) + 0x8000, 0), 0xFFFF));
+	}
+	return (uint32_t(layer) << 24) | (depth << 8) | atlas;
+}
+
+// Per-frame collector of debug lines, rectangle outlines and text (drawn with the RESOURCE.BIN
+// 8x8 font), all kept as one line-list vertex array and sent to Allegro by a single al_draw_prim()
+// in flush().  While disabled, every call returns at once and nothing is stored.  The vertex
+// array never grows past the capacity reserved up front (lines beyond it are dropped and
+// counted), so an enabled overlay can't allocate mid-game.
+class DebugDraw {
+public:
+	// Axis-aligned extent of everything collected (empty when x0 > x1)
+	struct box_t {
+		float x0, y0, x1, y1;
+		bool empty() const { return x0 > x1; }
+	};
+private:
+	std::vector<ALLEGRO_VERTEX>	verts_;
+	const ResourceBin			*font_;		// (nullptr: text() draws nothing)
+	bool						enabled_;
+	box_t						bounds_, last_bounds_;
+	unsigned long				dropped_;	// Lines that didn't fit
+
+	static box_t no_box() { return box_t{ FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX }; }
+
+	void vertex(float x, float y, ALLEGRO_COLOR color) {
+		verts_.push_back(ALLEGRO_VERTEX{ x, y, 0.0f, 0.0f, 0.0f, color });
+		bounds_.x0 = std::min(bounds_.x0, x);
+		bounds_.x1 = std::max(bounds_.x1, x);
+		bounds_.y0 = std::min(bounds_.y0, y);
+		bounds_.y1 = std::max(bounds_.y1, y);
+	}
+public:
+	explicit DebugDraw(const ResourceBin *font = nullptr, size_t reserve_vertices = 4096) :
+		font_{ font }, enabled_{ false }, bounds_(no_box()), last_bounds_(no_box()), dropped_{ 0u }
+	{
+		verts_.reserve(reserve_vertices);
+	}
+
+	bool enabled() const { return enabled_; }
+	void enable(bool on) { enabled_ = on; }
+	void toggle() { enabled_ = !enabled_; }
+
+	void line(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color) {
+		if (!enabled_) { return; }
+		if (verts_.size() + 2 > verts_.capacity()) {
+			++dropped_;
+			return;
+		}
+		vertex(x1, y1, color);
+		vertex(x2, y2, color);
+	}
+
+	// Outline of the pixels [x1, x2) x [y1, y2)
+	void rect(float x1, float y1, float x2, float y2, ALLEGRO_COLOR color) {
+		if (!enabled_) { return; }
+		line(x1, y1 + 0.5f, x2, y1 + 0.5f, color);
+		line(x1, y2 - 0.5f, x2, y2 - 0.5f, color);
+		line(x1 + 0.5f, y1 + 1.0f, x1 + 0.5f, y2 - 1.0f, color);
+		line(x2 - 0.5f, y1 + 1.0f, x2 - 0.5f, y2 - 1.0f, color);
+	}
+
+	// One horizontal line per run of lit pixels in each glyph row
+	void text(float x, float y, ALLEGRO_COLOR color, const char *str);
+
+	// Draw everything collected to the current target, then start over; returns the vertex count
+	size_t flush();
+
+	// Extent of what the next flush() will draw, and of what the previous one drew
+	const box_t& bounds() const { return bounds_; }
+	const box_t& last_bounds() const { return last_bounds_; }
+
+	unsigned long dropped() const { return dropped_; }
+};
+
+// Pixel rectangle on the VGA-sized render target
+struct rect_t {
+	int x, y, w, h;
+
+	bool overlaps(float ox, float oy, float ow, float oh) const {
+		return (ox < x + w) && (ox + ow > x) && (oy < y + h) && (oy + oh > y);
+	}
+};
+
+// One queued sprite draw
+struct sprite_draw_t {
+	ALLEGRO_BITMAP	*bitmap;
+	float			x, y;
+	uint32_t		key;		// Sort key (see sprite_sort_key())
+	uint16_t		flags;		// Debug outline flags (copied from CSprite::flags)
+	image_id_t		image;		// ImageBank handle <bitmap> came from (for non-Allegro renderers)
+
+	bool operator==(const sprite_draw_t& that) const {
+		return (image == that.image) && (bitmap == that.bitmap) && (x == that.x) && (y == that.y) && (key == that.key) && (flags == that.flags);
+	}
+	bool operator!=(const sprite_draw_t& that) const { return !(*this == that); }
+};
+
+// Per-frame collector of sprite draws. All storage comes from a FrameArena, so a batch
+// lives exactly as long as the frame that built it.
+//
+// submit() orders draws by their packed keys with a stable LSD radix sort (linear in the
+// number of draws; passes where every key has the same byte are skipped) and issues them inside
+// one held-drawing section, so Allegro flushes once per atlas change rather than once per sprite.
+class SpriteBatch {
+	FrameArena&		arena_;
+	sprite_draw_t	*draws_;		// In submission (entity) order
+	sprite_draw_t	*sorted_;		// In draw order (built on the first submit())
+	size_t			count_, capacity_;
+	size_t			groups_;		// Atlas runs (i.e., real draw calls) issued by the last submit()
+
+	void sort();
+public:
+	SpriteBatch(FrameArena& arena, size_t capacity) :
+		arena_{ arena }, draws_{ arena.alloc_array<sprite_draw_t>(capacity) }, sorted_{ nullptr },
+		count_{ 0u }, capacity_{ capacity }, groups_{ 0u } {}
+
+	void add(image_id_t image, ALLEGRO_BITMAP *bitmap, float x, float y, SPRITE_LAYER layer, uint8_t atlas, int flags) {
+		if (count_ < capacity_) {
+			draws_[count_++] = sprite_draw_t{ bitmap, x, y,
+				sprite_sort_key(layer, y, atlas), static_cast<uint16_t>(flags), image };
+		}
+	}
+
+	// Draw everything queued (or, given <clip>, just the draws touching it) to the current
+	// target bitmap; returns the number of atlas runs issued
+	size_t submit(const rect_t *clip = nullptr);
+
+	// Queue outlines of every draw with debug flags set (CSprite::flags bits 2/1/0 = red/green/blue)
+	void debug_outlines(DebugDraw& debug) const;
+
+	const sprite_draw_t *draws() const { return draws_; }
+
+	// All draws in the order submit() issues them
+	const sprite_draw_t *ordered() {
+		if (!sorted_) { sort(); }
+		return sorted_;
+	}
+	size_t size() const { return count_; }
+	size_t groups() const { return groups_; }
+};
+
+// Where (and how big) the VGA screen goes on a display: the largest whole-number scale that
+// fits, centered, with the rest letterboxed (scale is at least 1, even on tiny displays)
+struct viewport_t {
+	int scale;
+	int x, y, w, h;
+};
+
+viewport_t integer_viewport(int display_width, int display_height);
+
+// Visibility pass over flat arrays of sprite bounds: visible[i] = 1 if box i overlaps the
+// VGA screen at all, else 0; returns the number of visible boxes.  (A plain branch-free loop
+// over parallel arrays, so compilers vectorize it.)
+size_t cull_to_screen(const float *x, const float *y, const float *w, const float *h, size_t count, uint8_t *visible);
+
+// Which 16x16 tiles of the VGA screen need repainting this frame
+class DirtyTiles {
+public:
+	static constexpr int TILE = 16;
+	static constexpr int COLS = (VGA13_WIDTH + TILE - 1) / TILE;
+	static constexpr int ROWS = (VGA13_HEIGHT + TILE - 1) / TILE;
+	static constexpr int MAX_RECTS = COLS * ROWS;
+private:
+	uint32_t rows_[ROWS];	// One bit per column
+public:
+	DirtyTiles() { clear(); }
+
+	void clear() {
+		for (uint32_t& row : rows_) { row = 0u; }
+	}
+
+	void mark_all() {
+		for (uint32_t& row : rows_) { row = (1u << COLS) - 1u; }
+	}
+
+	// Mark every tile touched by the given pixel-space box (clipped to the screen)
+	void mark(float x, float y, float w, float h);
+
+	bool empty() const {
+		for (uint32_t row : rows_) { if (row) { return false; } }
+		return true;
+	}
+
+	// Merge dirty tiles into a few rectangles (horizontal runs, stacked vertically when they line up);
+	// writes up to MAX_RECTS entries to <out> and returns the count
+	size_t rects(rect_t *out) const;
+};
+
+#endif
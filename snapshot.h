@@ -0,0 +1,86 @@
+#pragma once
+#ifndef W2DIR_SNAPSHOT_H
+#define W2DIR_SNAPSHOT_H
+// Preallocated ring of binary world snapshots (for save states and rewind)
+//--------------------------------------------------------------------------
+
+#include <cstring>
+#include "common.h"
+
+// Snapshot columns are laid out on this boundary (so they can be read back in place)
+static constexpr size_t SNAPSHOT_ALIGN = 8;
+
+inline size_t snapshot_align(size_t n) {
+	return (n + SNAPSHOT_ALIGN - 1) & ~(SNAPSHOT_ALIGN - 1);
+}
+
+// Fixed number of fixed-size byte slots, each tagged with the tick it captured;
+// once full, every new snapshot overwrites the oldest one
+class SnapshotRing {
+	struct slot_t {
+		tick_t	tick;
+		size_t	bytes;		// Bytes actually used (0 == empty slot)
+	};
+
+	Buffer				storage_;		// slots_.size() * slot_bytes_ bytes
+	std::vector<slot_t>	slots_;
+	size_t				slot_bytes_;
+	size_t				newest_;		// Index of the most recently written slot
+	size_t				count_;			// Number of valid slots
+public:
+	SnapshotRing() : slot_bytes_{ 0u }, newest_{ 0u }, count_{ 0u } {}
+
+	// (Re)size the ring; discards any history
+	void allocate(size_t num_slots, size_t slot_bytes) {
+		slot_bytes_ = snapshot_align(slot_bytes);
+		storage_.assign(num_slots * slot_bytes_, 0u);
+		slots_.assign(num_slots, slot_t{ 0u, 0u });
+		newest_ = num_slots ? (num_slots - 1) : 0u;
+		count_ = 0u;
+	}
+
+	size_t capacity() const { return slots_.size(); }
+	size_t size() const { return count_; }
+	size_t slot_bytes() const { return slot_bytes_; }
+
+	// Claim a slot for <tick>: the next one (evicting the oldest if full), or the newest one again
+	// if it already holds <tick> (as it does right after a rewind to it), so retaking a tick
+	// never spends a second slot.  The caller fills it, then must call commit().
+	uint8_t *acquire(tick_t tick) {
+		if (slots_.empty()) { return nullptr; }
+		if ((count_ == 0) || (slots_[newest_].tick != tick)) {
+			newest_ = (newest_ + 1) % slots_.size();
+			if (count_ < slots_.size()) { ++count_; }
+		}
+		slots_[newest_] = slot_t{ tick, 0u };
+		return &storage_[newest_ * slot_bytes_];
+	}
+
+	void commit(size_t bytes) {
+		slots_[newest_].bytes = bytes;
+	}
+
+	// Find the snapshot taken at <tick> (nullptr if it has already been overwritten)
+	const uint8_t *find(tick_t tick) const {
+		for (size_t n = 0, i = newest_; n < count_; ++n, i = (i + slots_.size() - 1) % slots_.size()) {
+			if ((slots_[i].tick == tick) && slots_[i].bytes) { return &storage_[i * slot_bytes_]; }
+		}
+		return nullptr;
+	}
+
+	// Oldest tick still held (only meaningful if size() > 0)
+	tick_t oldest_tick() const {
+		return slots_[(newest_ + slots_.size() + 1 - count_) % slots_.size()].tick;
+	}
+
+	// Forget every snapshot newer than <tick> (after rewinding, those futures never happened)
+	void truncate_after(tick_t tick) {
+		while ((count_ > 0) && (slots_[newest_].tick > tick)) {
+			slots_[newest_].bytes = 0u;
+			newest_ = (newest_ + slots_.size() - 1) % slots_.size();
+			--count_;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,244 @@
+// CPU renderer for 8-bit indexed (VGA mode 13h style) frames
+//------------------------------------------------------------
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define W2DIR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "softrender.h"
+
+// Transparent runs at least this long split a sprite row into separate spans
+// (shorter ones are cheaper to skip with the masked blitter)
+static constexpr size_t MIN_SPAN_GAP = 4;
+
+// Copy <count> indices from <src> to <dst>, except where the source is 0 (transparent)
+static void blit_masked(uint8_t *dst, const uint8_t *src, size_t count) {
+	size_t i = 0;
+#if W2DIR_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16) {
+		__m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+		__m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+		__m128i clear = _mm_cmpeq_epi8(s, zero);
+		d = _mm_or_si128(_mm_and_si128(clear, d), _mm_andnot_si128(clear, s));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), d);
+	}
+#endif
+	for (; i < count; ++i) {
+		if (src[i]) { dst[i] = src[i]; }
+	}
+}
+
+// Expand <count> indices through <pal>, repeating each resulting pixel <scale> times
+static void expand_row(uint32_t *dst, const uint8_t *src, size_t count, const PackedPalette& pal, int scale) {
+	size_t x = 0;
+#if W2DIR_SSE2
+	if (scale == 2) {
+		for (; x + 4 <= count; x += 4, dst += 8) {
+			__m128i c = _mm_set_epi32(int(pal[src[x + 3]]), int(pal[src[x + 2]]), int(pal[src[x + 1]]), int(pal[src[x]]));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_unpacklo_epi32(c, c));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4), _mm_unpackhi_epi32(c, c));
+		}
+	}
+	else if ((scale % 4) == 0) {
+		for (; x < count; ++x) {
+			__m128i c = _mm_set1_epi32(int(pal[src[x]]));
+			for (int k = 0; k < scale; k += 4, dst += 4) {
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), c);
+			}
+		}
+	}
+#endif
+	for (; x < count; ++x) {
+		uint32_t c = pal[src[x]];
+		for (int k = 0; k < scale; ++k) { *dst++ = c; }
+	}
+}
+
+// One source row of Scale2x (EPX): writes two output rows of 2 * VGA13_WIDTH indices each
+static void scale2x_row(uint8_t *out0, uint8_t *out1, const uint8_t *above, const uint8_t *row, const uint8_t *below) {
+	for (size_t x = 0; x < VGA13_WIDTH; ++x) {
+		uint8_t p = row[x];
+		uint8_t a = above[x], d = below[x];
+		uint8_t c = row[(x > 0) ? (x - 1) : x];
+		uint8_t b = row[(x + 1 < VGA13_WIDTH) ? (x + 1) : x];
+		out0[x * 2] = ((c == a) && (c != d) && (a != b)) ? a : p;
+		out0[x * 2 + 1] = ((a == b) && (a != c) && (b != d)) ? b : p;
+		out1[x * 2] = ((d == c) && (d != b) && (c != a)) ? c : p;
+		out1[x * 2 + 1] = ((b == d) && (b != a) && (d != c)) ? d : p;
+	}
+}
+
+static uint32_t pack_color(ALLEGRO_COLOR c, float level) {
+	unsigned char r, g, b;
+	al_unmap_rgb(c, &r, &g, &b);
+	uint32_t pr = static_cast<uint32_t>(r * level + 0.5f);
+	uint32_t pg = static_cast<uint32_t>(g * level + 0.5f);
+	uint32_t pb = static_cast<uint32_t>(b * level + 0.5f);
+	return 0xFF000000u | (pb << 16) | (pg << 8) | pr;
+}
+
+IndexedSprites::IndexedSprites(const Buffer& sheet) : sheet_(SHEET_WIDTH * SHEET_HEIGHT, 0u) {
+	std::copy_n(sheet.begin(), std::min(sheet.size(), sheet_.size()), sheet_.begin());
+
+	for (size_t n = 0; n < NUM_SPRITES; ++n) {
+		first_[n] = static_cast<uint32_t>(spans_.size());
+		const size_t left = (n % SPRITES_COLS) * SPRITE_WIDTH;
+		const size_t top = (n / SPRITES_COLS) * SPRITE_HEIGHT;
+
+		for (size_t y = 0; y < SPRITE_HEIGHT; ++y) {
+			const size_t row = ((top + y) * SHEET_WIDTH) + left;
+			size_t x = 0;
+			while (x < SPRITE_WIDTH) {
+				// Skip transparency, then extend the span until a long-enough gap (or the edge)
+				while ((x < SPRITE_WIDTH) && !sheet_[row + x]) { ++x; }
+				if (x == SPRITE_WIDTH) { break; }
+
+				size_t start = x, end = x, gap = 0;
+				for (; (x < SPRITE_WIDTH) && (gap < MIN_SPAN_GAP); ++x) {
+					if (sheet_[row + x]) {
+						end = x + 1;
+						gap = 0;
+					}
+					else {
+						++gap;
+					}
+				}
+				spans_.push_back(span_t{ static_cast<uint8_t>(start), static_cast<uint8_t>(y),
+					static_cast<uint8_t>(end - start), static_cast<uint32_t>(row + start) });
+			}
+		}
+	}
+	first_[NUM_SPRITES] = static_cast<uint32_t>(spans_.size());
+}
+
+SoftRenderer::SoftRenderer(const SpritesBin& sprites, const Buffer& background,
+	const Palette& background_pal, const Palette& game_pal) :
+	sprites_{ sprites.indexed() }, background_(VGA13_WIDTH * VGA13_HEIGHT, 0u),
+	frame_(VGA13_WIDTH * VGA13_HEIGHT, 0u), level_{ 1.0f }
+{
+	// Nearest game-palette color for every background color (done once, at load time)
+	std::array<uint8_t, VGA13_COLORS> remap;
+	for (size_t i = 0; i < VGA13_COLORS; ++i) {
+		unsigned char r, g, b;
+		al_unmap_rgb(background_pal[i], &r, &g, &b);
+		int best = INT_MAX;
+		for (size_t j = 0; j < VGA13_COLORS; ++j) {
+			unsigned char gr, gg, gb;
+			al_unmap_rgb(game_pal[j], &gr, &gg, &gb);
+			int dist = ((r - gr) * (r - gr)) + ((g - gg) * (g - gg)) + ((b - gb) * (b - gb));
+			if (dist < best) {
+				best = dist;
+				remap[i] = static_cast<uint8_t>(j);
+			}
+		}
+	}
+	for (size_t i = 0; i < std::min(background.size(), background_.size()); ++i) {
+		background_[i] = remap[background[i]];
+	}
+
+	set_palette(game_pal);
+}
+
+void SoftRenderer::set_palette(const Palette& pal) {
+	for (size_t i = 0; i < VGA13_COLORS; ++i) {
+		base_[i] = pack_color(pal[i], 1.0f);
+	}
+	fade(level_);
+}
+
+void SoftRenderer::fade(float level) {
+	level_ = std::min(std::max(level, 0.0f), 1.0f);
+	for (size_t i = 0; i < VGA13_COLORS; ++i) {
+		uint32_t c = base_[i];
+		uint32_t r = static_cast<uint32_t>((c & 0xFFu) * level_ + 0.5f);
+		uint32_t g = static_cast<uint32_t>(((c >> 8) & 0xFFu) * level_ + 0.5f);
+		uint32_t b = static_cast<uint32_t>(((c >> 16) & 0xFFu) * level_ + 0.5f);
+		palette_[i] = 0xFF000000u | (b << 16) | (g << 8) | r;
+	}
+}
+
+void SoftRenderer::draw_background() {
+	std::memcpy(frame_.data(), background_.data(), frame_.size());
+}
+
+void SoftRenderer::draw_sprite(size_t shape, int x, int y) {
+	const uint8_t *pixels = sprites_.pixels();
+	for (auto span = sprites_.spans_begin(shape); span != sprites_.spans_end(shape); ++span) {
+		int dy = y + span->y;
+		if ((dy < 0) || (dy >= int(VGA13_HEIGHT))) { continue; }
+
+		// Clip the span horizontally
+		int dx = x + span->x;
+		int skip = std::max(0, -dx);
+		int len = std::min(int(span->len), int(VGA13_WIDTH) - dx) - skip;
+		if (len <= 0) { continue; }
+
+		blit_masked(&frame_[(dy * VGA13_WIDTH) + dx + skip], pixels + span->offset + skip, len);
+	}
+}
+
+void SoftRenderer::draw(SpriteBatch& batch) {
+	const sprite_draw_t *draws = batch.ordered();
+	for (size_t i = 0; i < batch.size(); ++i) {
+		const sprite_draw_t& d = draws[i];
+		if (d.image < (ResourceBin::PAL_COUNT * NUM_SPRITES)) {
+			draw_sprite(d.image % NUM_SPRITES, int(std::floor(d.x)), int(std::floor(d.y)));
+		}
+	}
+}
+
+void SoftRenderer::present(ALLEGRO_BITMAP *target, int scale, SCALE_FILTER filter) const {
+	if ((al_get_bitmap_width(target) != int(VGA13_WIDTH) * scale) || (al_get_bitmap_height(target) != int(VGA13_HEIGHT) * scale)) {
+		throw std::exception("SoftRenderer::present target size doesn't match the scale");
+	}
+
+	ALLEGRO_LOCKED_REGION *lr = al_lock_bitmap(target, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+	if (!lr) { throw std::exception("Unable to lock ALLEGRO_BITMAP for writing"); }
+
+	uint8_t *base = static_cast<uint8_t *>(lr->data);
+	const size_t row_bytes = VGA13_WIDTH * scale * sizeof(uint32_t);
+	int out_y = 0;
+
+	// Expand one output row, then copy it down for the rest of its vertical repeats
+	auto emit = [&](const uint8_t *indices, size_t count, int hscale, int vscale) {
+		uint32_t *first = reinterpret_cast<uint32_t *>(base + (out_y * lr->pitch));
+		expand_row(first, indices, count, palette_, hscale);
+		for (int k = 1; k < vscale; ++k) {
+			std::memcpy(base + ((out_y + k) * lr->pitch), first, row_bytes);
+		}
+		out_y += vscale;
+	};
+
+	const uint8_t *src = frame_.data();
+	if ((filter == FILTER_SCALE2X) && ((scale % 2) == 0)) {
+		uint8_t rows[2][VGA13_WIDTH * 2];
+		for (size_t y = 0; y < VGA13_HEIGHT; ++y) {
+			const uint8_t *row = src + (y * VGA13_WIDTH);
+			const uint8_t *above = (y > 0) ? (row - VGA13_WIDTH) : row;
+			const uint8_t *below = (y + 1 < VGA13_HEIGHT) ? (row + VGA13_WIDTH) : row;
+			scale2x_row(rows[0], rows[1], above, row, below);
+			emit(rows[0], VGA13_WIDTH * 2, scale / 2, scale / 2);
+			emit(rows[1], VGA13_WIDTH * 2, scale / 2, scale / 2);
+		}
+	}
+	else {
+		for (size_t y = 0; y < VGA13_HEIGHT; ++y, src += VGA13_WIDTH) {
+			emit(src, VGA13_WIDTH, scale, scale);
+		}
+	}
+	al_unlock_bitmap(target);
+}
+
+uint32_t SoftRenderer::checksum() const {
+	uint32_t hash = 2166136261u;
+	for (uint8_t c : frame_) {
+		hash = (hash ^ c) * 16777619u;
+	}
+	return hash;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef W2DIR_SOFTRENDER_H
+#define W2DIR_SOFTRENDER_H
+// CPU renderer for 8-bit indexed (VGA mode 13h style) frames
+//------------------------------------------------------------
+
+#include <allegro5/allegro.h>
+
+#include "common.h"
+#include "assets.h"
+#include "render.h"
+
+// How present() enlarges the frame
+enum SCALE_FILTER {
+	FILTER_NEAREST,		// Plain pixel replication
+	FILTER_SCALE2X,		// EPX/Scale2x edge smoothing (even scales only; others fall back to nearest)
+};
+
+// 32-bit colors as stored by ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE (red in the low byte)
+using PackedPalette = std::array<uint32_t, VGA13_COLORS>;
+
+// The SPRITES.BIN grid kept as raw palette indices, with every sprite pre-cut into spans:
+// each row keeps only the pixels between long runs of transparent (index 0) pixels, so
+// blank rows and margins cost nothing to draw.  Short holes stay inside their span and are
+// skipped by the masked blitter instead.
+class IndexedSprites {
+public:
+	struct span_t {
+		uint8_t		x, y, len;		// Position within the sprite, pixel count
+		uint32_t	offset;			// Index of the span's first pixel in the sheet
+	};
+
+	static constexpr size_t SHEET_WIDTH = SPRITES_COLS * SPRITE_WIDTH;
+	static constexpr size_t SHEET_HEIGHT = SPRITES_ROWS * SPRITE_HEIGHT;
+private:
+	Buffer								sheet_;
+	std::vector<span_t>					spans_;
+	std::array<uint32_t, NUM_SPRITES + 1>	first_;		// Sprite n owns spans [first_[n], first_[n + 1])
+public:
+	explicit IndexedSprites(const Buffer& sheet);
+
+	const span_t *spans_begin(size_t shape) const { return spans_.data() + first_[shape]; }
+	const span_t *spans_end(size_t shape) const { return spans_.data() + first_[shape + 1]; }
+	const uint8_t *pixels() const { return sheet_.data(); }
+};
+
+// Draws sprites into a 320x200 byte-per-pixel frame and expands it to RGBA only when the
+// frame is presented.  Palette swaps and fades rewrite the 256-entry color table (nothing
+// else), and the output depends only on the inputs (no GPU, no display needed).
+//
+// Like VGA hardware, one palette applies to the whole frame; an image's palette (see
+// ImageBank::sprite_id) is ignored and only its shape is drawn.
+class SoftRenderer {
+	IndexedSprites	sprites_;
+	Buffer			background_;	// Frame-sized, already remapped to the game palette
+	Buffer			frame_;
+	PackedPalette	base_;			// Current palette at full brightness
+	PackedPalette	palette_;		// ...after fading (used by present())
+	float			level_;
+public:
+	// <background> is raw BSAVEd data drawn with <background_pal>; it is remapped (once) to the
+	// nearest colors of <game_pal>, which becomes the current palette
+	SoftRenderer(const SpritesBin& sprites, const Buffer& background,
+		const Palette& background_pal, const Palette& game_pal);
+
+	// Switch to another palette (keeps the current fade level)
+	void set_palette(const Palette& pal);
+
+	// Scale every color toward black (0.0) or back to full brightness (1.0)
+	void fade(float level);
+
+	void draw_background();
+	void draw_sprite(size_t shape, int x, int y);
+
+	// Draw every SpritesBin image in <batch> (in batch order); other images are skipped
+	void draw(SpriteBatch& batch);
+
+	// Expand the frame through the current palette into <target>, which must be exactly
+	// <scale> times the size of the VGA screen (filtering, expansion and scaling are one pass)
+	void present(ALLEGRO_BITMAP *target, int scale = 1, SCALE_FILTER filter = FILTER_NEAREST) const;
+
+	// FNV-1a hash of the indexed frame (for determinism checks)
+	uint32_t checksum() const;
+
+	const uint8_t *frame() const { return frame_.data(); }
+	const PackedPalette& palette() const { return palette_; }
+};
+
+#endif
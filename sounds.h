@@ -0,0 +1,56 @@
+#pragma once
+#ifndef W2DIR_SOUNDS_H
+#define W2DIR_SOUNDS_H
+// Sound event channel (simulation -> audio)
+//-------------------------------------------
+
+#include <algorithm>
+#include <vector>
+
+#include "common.h"
+
+// Index of a RESOURCE.BIN sound effect, or none
+using sound_id_t = int;
+constexpr sound_id_t NO_SOUND = -1;
+
+// One request to play a sound, as made by a system during a tick
+struct sound_event_t {
+	sound_id_t	sound;
+	float		pan;		// -1.0 (left) to 1.0 (right)
+	float		gain;
+};
+
+// Systems emit() sound events here instead of playing anything; the audio side drains the
+// channel once per tick (see SoundCoalescer).  Capacity is fixed, so a burst of triggers
+// can never allocate: once full, further events in the same tick are dropped and counted.
+class SoundChannel {
+	std::vector<sound_event_t>	events_;
+	size_t						capacity_;
+	unsigned long				emitted_, overflowed_;
+public:
+	explicit SoundChannel(size_t capacity = 256) : capacity_{ capacity }, emitted_{ 0u }, overflowed_{ 0u } {
+		events_.reserve(capacity);
+	}
+
+	// Request <sound> from screen X coordinate <x> (which sets the pan)
+	bool emit(sound_id_t sound, float x, float gain = 1.0f) {
+		++emitted_;
+		if (events_.size() >= capacity_) {
+			++overflowed_;
+			return false;
+		}
+		float pan = std::min(std::max((x / (VGA13_WIDTH * 0.5f)) - 1.0f, -1.0f), 1.0f);
+		events_.push_back(sound_event_t{ sound, pan, gain });
+		return true;
+	}
+
+	const sound_event_t *begin() const { return events_.data(); }
+	const sound_event_t *end() const { return events_.data() + events_.size(); }
+	size_t size() const { return events_.size(); }
+	void clear() { events_.clear(); }
+
+	unsigned long emitted() const { return emitted_; }
+	unsigned long overflowed() const { return overflowed_; }
+};
+
+#endif
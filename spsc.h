@@ -0,0 +1,53 @@
+#pragma once
+#ifndef W2DIR_SPSC_H
+#define W2DIR_SPSC_H
+// Lock-free single-producer/single-consumer ring buffer
+//-------------------------------------------------------
+
+#include <atomic>
+#include <vector>
+
+// Fixed number of preallocated slots handed back and forth between exactly one producer
+// thread and one consumer thread.  Neither side ever blocks or allocates: the producer gets
+// nullptr from acquire() when the ring is full, the consumer gets nullptr from peek() when
+// it is empty.  Slots are filled/read in place, so large payloads are never copied twice.
+template<typename T>
+class SpscRing {
+	std::vector<T>				slots_;
+	alignas(64) std::atomic<size_t>	head_;		// Slots published so far (written by the producer)
+	alignas(64) std::atomic<size_t>	tail_;		// Slots released so far (written by the consumer)
+public:
+	explicit SpscRing(size_t capacity, const T& prototype = T{}) : slots_(capacity, prototype), head_{ 0u }, tail_{ 0u } {}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	size_t capacity() const { return slots_.size(); }
+
+	// Approximate (the other side may be moving)
+	size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+
+	// Producer: the next free slot to fill (nullptr if full), then publish() it
+	T *acquire() {
+		size_t head = head_.load(std::memory_order_relaxed);
+		if (head - tail_.load(std::memory_order_acquire) >= slots_.size()) { return nullptr; }
+		return &slots_[head % slots_.size()];
+	}
+
+	void publish() {
+		head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer: the oldest published slot (nullptr if empty), then release() it when done
+	T *peek() {
+		size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail == head_.load(std::memory_order_acquire)) { return nullptr; }
+		return &slots_[tail % slots_.size()];
+	}
+
+	void release() {
+		tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+};
+
+#endif
@@ -0,0 +1,277 @@
+#pragma once
+#ifndef W2DIR_TIMING_H
+#define W2DIR_TIMING_H
+// Fixed-timestep simulation clock and frame pacing
+//--------------------------------------------------
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+
+// Turns elapsed wall-clock time into a whole number of fixed-length simulation ticks.
+// Leftover time is carried over to the next call (and exposed as alpha() for interpolation);
+// catch-up is capped per call so one very slow frame can't snowball ("spiral of death").
+class FixedStep {
+	double step_;			// Seconds per tick
+	double last_;			// Wall-clock time of the previous advance()
+	double accum_;			// Seconds owed to the simulation
+	unsigned max_ticks_;	// Catch-up cap per advance()
+	unsigned long dropped_;	// Ticks thrown away by the cap (i.e., the game ran slow)
+public:
+	FixedStep(double ticks_per_second, unsigned max_ticks, double now) :
+		step_{ 1.0 / ticks_per_second }, last_{ now }, accum_{ 0.0 },
+		max_ticks_{ max_ticks }, dropped_{ 0u } {}
+
+	// Restart timing from <now> (e.g., after a pause or a long load)
+	void reset(double now) {
+		last_ = now;
+		accum_ = 0.0;
+	}
+
+	// Account for the time elapsed up to <now>; returns how many ticks to simulate
+	unsigned advance(double now) {
+		accum_ += (now > last_) ? (now - last_) : 0.0;
+		last_ = now;
+
+		unsigned ticks = 0u;
+		while ((accum_ >= step_) && (ticks < max_ticks_)) {
+			accum_ -= step_;
+			++ticks;
+		}
+
+		// Still behind after the cap?  Drop the backlog rather than chase it forever
+		if (accum_ >= step_) {
+			dropped_ += static_cast<unsigned long>(accum_ / step_);
+			accum_ -= step_ * static_cast<unsigned long>(accum_ / step_);
+		}
+		return ticks;
+	}
+
+	// Fraction [0, 1) of the way from the last simulated state to the next one
+	float alpha() const { return static_cast<float>(accum_ / step_); }
+
+	double step() const { return step_; }
+	unsigned long dropped() const { return dropped_; }
+};
+
+// Rolling window of the last WINDOW samples of some duration (seconds)
+class FrameStats {
+public:
+	static constexpr size_t WINDOW = 256;
+private:
+	std::array<double, WINDOW> samples_;
+	size_t count_, next_;
+public:
+	FrameStats() : count_{ 0u }, next_{ 0u } {}
+
+	void add(double seconds) {
+		samples_[next_] = seconds;
+		next_ = (next_ + 1) % WINDOW;
+		if (count_ < WINDOW) { ++count_; }
+	}
+
+	size_t size() const { return count_; }
+
+	double mean() const {
+		double sum = 0.0;
+		for (size_t i = 0; i < count_; ++i) { sum += samples_[i]; }
+		return count_ ? (sum / count_) : 0.0;
+	}
+
+	// 99th percentile (sorts a copy of the window, so call it for reports, not every frame)
+	double p99() const {
+		if (!count_) { return 0.0; }
+		std::array<double, WINDOW> sorted = samples_;
+		size_t rank = std::min(count_ - 1, (count_ * 99) / 100);
+		std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.begin() + count_);
+		return sorted[rank];
+	}
+
+	// Standard deviation
+	double jitter() const {
+		if (!count_) { return 0.0; }
+		double m = mean(), sum = 0.0;
+		for (size_t i = 0; i < count_; ++i) { sum += (samples_[i] - m) * (samples_[i] - m); }
+		return std::sqrt(sum / count_);
+	}
+};
+
+// How frames reach the display
+enum PRESENT_MODE {
+	PRESENT_IMMEDIATE,	// No vsync: the pacer alone holds frames to the target cadence
+	PRESENT_VSYNC,		// Vsync: flips block until the display's refresh
+	PRESENT_TRIPLE,		// Vsync, but rendering may start a frame early (the latency tradeoff of a third buffer)
+};
+
+// Decides when the next frame should be rendered and presented, and measures how each frame
+// went: simulate/render/present time, present-to-present interval, and how late each present
+// was against its slot.  Time comes from an injected monotonic clock (seconds), so the same
+// logic can be driven by a fake clock and checked without a display.
+class FramePacer {
+public:
+	using clock_fn = std::function<double()>;
+
+	enum PHASE {
+		SIMULATE,
+		RENDER,
+		PRESENT,
+		PHASE_COUNT
+	};
+private:
+	clock_fn		now_;
+	double			period_;			// Target seconds between presents
+	PRESENT_MODE	mode_;
+	double			next_slot_;			// When the next present is due
+	double			last_present_;
+	double			phase_start_;
+	double			phase_accum_[PHASE_COUNT];	// This frame's time in each phase (so far)
+	FrameStats		phases_[PHASE_COUNT], intervals_, lateness_;
+	unsigned long	frames_, missed_;	// Frames presented; slots skipped because a frame ran long
+public:
+	FramePacer(double hz, PRESENT_MODE mode, clock_fn now) :
+		now_{ std::move(now) }, period_{ 1.0 / hz }, mode_{ mode }, frames_{ 0u }, missed_{ 0u }
+	{
+		reset();
+	}
+
+	// Start a fresh schedule from the current time (e.g., after a pause or a long load)
+	void reset() {
+		next_slot_ = last_present_ = phase_start_ = now_();
+		for (double& a : phase_accum_) { a = 0.0; }
+	}
+
+	PRESENT_MODE mode() const { return mode_; }
+	double period() const { return period_; }
+
+	// Is it time to render (and then present) a frame?
+	bool frame_due() const {
+		double lead = (mode_ == PRESENT_TRIPLE) ? period_ : 0.0;
+		return now_() >= (next_slot_ - lead);
+	}
+
+	// Seconds until frame_due() becomes true (0 if it already is)
+	double time_to_due() const {
+		double lead = (mode_ == PRESENT_TRIPLE) ? period_ : 0.0;
+		return std::max(0.0, (next_slot_ - lead) - now_());
+	}
+
+	// Bracket the work of one phase (a phase may run several times per frame; times add up)
+	void begin(PHASE) { phase_start_ = now_(); }
+	void end(PHASE phase) { phase_accum_[phase] += now_() - phase_start_; }
+
+	// Close the frame slot just used and schedule the next one.  Only a frame that actually
+	// reached the display (<flipped>) counts in the stats; a skipped present (nothing changed)
+	// still takes its slot, but its phase times are dropped.
+	void presented(bool flipped = true) {
+		double now = now_();
+		for (size_t p = 0; p < PHASE_COUNT; ++p) {
+			if (flipped) { phases_[p].add(phase_accum_[p]); }
+			phase_accum_[p] = 0.0;
+		}
+		if (flipped) {
+			if (frames_++) { intervals_.add(now - last_present_); }
+			lateness_.add(std::max(0.0, now - next_slot_));
+			last_present_ = now;
+		}
+
+		// Next slot on the cadence; if we're a whole period (or more) behind, skip the missed
+		// slots instead of bunching up frames to catch up
+		next_slot_ += period_;
+		if (now - next_slot_ >= period_) {
+			unsigned long behind = static_cast<unsigned long>((now - next_slot_) / period_);
+			missed_ += behind;
+			next_slot_ += behind * period_;
+		}
+	}
+
+	const FrameStats& phase(PHASE p) const { return phases_[p]; }
+	const FrameStats& intervals() const { return intervals_; }
+	const FrameStats& lateness() const { return lateness_; }
+	unsigned long frames() const { return frames_; }
+	unsigned long missed() const { return missed_; }
+};
+
+// Whole-run histogram of some latency, in 1ms buckets (the last one also takes everything longer)
+class LatencyHistogram {
+public:
+	static constexpr size_t BUCKETS = 100;
+	static constexpr double BUCKET_SECONDS = 0.001;
+private:
+	std::array<unsigned long, BUCKETS> counts_;
+	unsigned long total_;
+	double sum_, max_;
+public:
+	LatencyHistogram() : total_{ 0u }, sum_{ 0.0 }, max_{ 0.0 } { counts_.fill(0u); }
+
+	void add(double seconds) {
+		seconds = std::max(seconds, 0.0);
+		size_t bucket = std::min(static_cast<size_t>(seconds / BUCKET_SECONDS), BUCKETS - 1);
+		++counts_[bucket];
+		++total_;
+		sum_ += seconds;
+		max_ = std::max(max_, seconds);
+	}
+
+	unsigned long count() const { return total_; }
+	unsigned long bucket(size_t i) const { return counts_[i]; }
+	double mean() const { return total_ ? (sum_ / total_) : 0.0; }
+	double max() const { return max_; }
+
+	// Upper edge of the bucket holding the <pct>th percentile
+	double percentile(double pct) const {
+		unsigned long rank = static_cast<unsigned long>(std::ceil(total_ * pct / 100.0)), seen = 0u;
+		for (size_t i = 0; i < BUCKETS; ++i) {
+			seen += counts_[i];
+			if (seen && (seen >= rank)) { return (i + 1) * BUCKET_SECONDS; }
+		}
+		return 0.0;
+	}
+};
+
+// Follows input from the event that changed it, through the simulation tick that read it, to
+// the present of the frame that shows it.  Several inputs before the same tick are one sample
+// (timed from the oldest), since the tick sees them together.  All times on the al_get_time()
+// clock (which is also what ALLEGRO_EVENT timestamps use).
+class InputLatency {
+	double			pending_;			// Oldest input no tick has read yet (< 0: none)
+	double			input_, tick_;		// Oldest input read by a tick, but not presented yet (< 0: none)
+	unsigned long	inputs_, coalesced_;
+	LatencyHistogram	to_tick_, to_present_, tick_to_present_;
+public:
+	InputLatency() : pending_{ -1.0 }, input_{ -1.0 }, tick_{ -1.0 }, inputs_{ 0u }, coalesced_{ 0u } {}
+
+	// An event at <timestamp> changed the input state
+	void input(double timestamp) {
+		++inputs_;
+		if (pending_ < 0.0) { pending_ = timestamp; }
+		else { ++coalesced_; }
+	}
+
+	// A simulation tick read the input state at <now>
+	void consumed(double now) {
+		if (pending_ < 0.0) { return; }
+		to_tick_.add(now - pending_);
+		if (input_ < 0.0) {
+			input_ = pending_;
+			tick_ = now;
+		}
+		pending_ = -1.0;
+	}
+
+	// A frame (rendered after those ticks) was presented at <now>
+	void presented(double now) {
+		if (input_ < 0.0) { return; }
+		to_present_.add(now - input_);
+		tick_to_present_.add(now - tick_);
+		input_ = tick_ = -1.0;
+	}
+
+	unsigned long inputs() const { return inputs_; }
+	unsigned long coalesced() const { return coalesced_; }
+	const LatencyHistogram& to_tick() const { return to_tick_; }
+	const LatencyHistogram& to_present() const { return to_present_; }
+	const LatencyHistogram& tick_to_present() const { return tick_to_present_; }
+};
+
+#endif
@@ -0,0 +1,129 @@
+// Timeline tracing (Chrome trace-event format)
+//----------------------------------------------
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "trace.h"
+
+namespace {
+	using clock = std::chrono::steady_clock;
+
+	struct event_t {
+		const char	*name;
+		char		phase;			// 'B'egin, 'E'nd, 'C'ounter
+		double		ts;				// Microseconds since start()
+		double		value;			// (counters)
+	};
+
+	struct thread_buffer_t {
+		unsigned					tid;
+		const char					*name;
+		std::vector<event_t>		events;
+		std::atomic<size_t>			count;		// Published events
+		std::atomic<unsigned long>	dropped;
+
+		explicit thread_buffer_t(unsigned tid_) : tid{ tid_ }, name{ nullptr }, events(Trace::THREAD_EVENTS), count{ 0u }, dropped{ 0u } {}
+	};
+
+	clock::time_point	g_epoch;
+	std::mutex			g_registry_lock;
+	std::vector<std::unique_ptr<thread_buffer_t>>	g_buffers;
+	thread_local thread_buffer_t	*t_buffer = nullptr;
+
+	thread_buffer_t& this_thread_buffer() {
+		if (!t_buffer) {
+			std::lock_guard<std::mutex> hold{ g_registry_lock };
+			g_buffers.emplace_back(new thread_buffer_t{ static_cast<unsigned>(g_buffers.size() + 1) });
+			t_buffer = g_buffers.back().get();
+		}
+		return *t_buffer;
+	}
+
+	void record(const char *name, char phase, double value) {
+		if (!Trace::enabled()) { return; }
+		thread_buffer_t& buf = this_thread_buffer();
+		size_t n = buf.count.load(std::memory_order_relaxed);
+		if (n == buf.events.size()) {
+			buf.dropped.fetch_add(1u, std::memory_order_relaxed);
+			return;
+		}
+		double ts = std::chrono::duration<double, std::micro>(clock::now() - g_epoch).count();
+		buf.events[n] = event_t{ name, phase, ts, value };
+		buf.count.store(n + 1, std::memory_order_release);
+	}
+
+	// JSON string body (names are ours, but quotes/backslashes/control characters are still escaped)
+	void write_string(std::ofstream& out, const char *s) {
+		out << '"';
+		for (; *s; ++s) {
+			if ((*s == '"') || (*s == '\\')) { out << '\\' << *s; }
+			else if (static_cast<unsigned char>(*s) < 0x20) { out << ' '; }
+			else { out << *s; }
+		}
+		out << '"';
+	}
+}
+
+std::atomic<bool> Trace::enabled_{ false };
+
+void Trace::start() {
+	g_epoch = clock::now();
+	enabled_.store(true);
+	thread_name("main");
+}
+
+void Trace::begin(const char *name) { record(name, 'B', 0.0); }
+void Trace::end(const char *name) { record(name, 'E', 0.0); }
+void Trace::counter(const char *name, double value) { record(name, 'C', value); }
+
+void Trace::thread_name(const char *name) {
+	if (enabled()) { this_thread_buffer().name = name; }
+}
+
+unsigned long Trace::dropped() {
+	std::lock_guard<std::mutex> hold{ g_registry_lock };
+	unsigned long total = 0u;
+	for (const auto& buf : g_buffers) { total += buf->dropped.load(); }
+	return total;
+}
+
+bool Trace::write(const char *filename) {
+	std::ofstream out{ filename };
+	if (!out) { return false; }
+
+	std::lock_guard<std::mutex> hold{ g_registry_lock };
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	auto next = [&]() {
+		if (!first) { out << ",\n"; }
+		first = false;
+	};
+
+	out.precision(3);
+	out << std::fixed;
+	for (const auto& buf : g_buffers) {
+		if (buf->name) {
+			next();
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf->tid << ",\"args\":{\"name\":";
+			write_string(out, buf->name);
+			out << "}}";
+		}
+
+		const size_t count = buf->count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i) {
+			const event_t& e = buf->events[i];
+			next();
+			out << "{\"name\":";
+			write_string(out, e.name);
+			out << ",\"ph\":\"" << e.phase << "\",\"ts\":" << e.ts << ",\"pid\":1,\"tid\":" << buf->tid;
+			if (e.phase == 'C') { out << ",\"args\":{\"value\":" << e.value << '}'; }
+			out << '}';
+		}
+	}
+	out << "\n]}\n";
+	return bool(out);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef W2DIR_TRACE_H
+#define W2DIR_TRACE_H
+// Timeline tracing (Chrome trace-event format)
+//----------------------------------------------
+
+#include <atomic>
+
+#include "common.h"
+
+// Records begin/end and counter events from any thread into per-thread buffers, and writes
+// them out as Chrome trace-event JSON (open it in Perfetto or chrome://tracing).
+//
+// Each thread appends to a buffer only it writes (published with one atomic store per
+// event), so recording never locks or waits; a thread's first event registers its buffer
+// (that takes a lock, once).  A full buffer drops further events (and counts them).
+// Everything is a no-op until start().
+//
+// Event names must outlive the trace (string literals, static tables).
+class Trace {
+	static std::atomic<bool>	enabled_;
+public:
+	static constexpr size_t THREAD_EVENTS = 1u << 17;	// Buffer size per thread
+
+	static void start();
+
+	// (inline, so an idle TRACE_SCOPE is one load and one branch)
+	static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+	static void begin(const char *name);
+	static void end(const char *name);
+	static void counter(const char *name, double value);
+
+	// Label the calling thread in the viewer
+	static void thread_name(const char *name);
+
+	// Write every recorded event (call once no other thread is recording)
+	static bool write(const char *filename);
+
+	static unsigned long dropped();
+};
+
+// Begin/end pair around the enclosing scope
+class TraceScope {
+	const char	*name_;
+public:
+	explicit TraceScope(const char *name) : name_{ Trace::enabled() ? name : nullptr } {
+		if (name_) { Trace::begin(name_); }
+	}
+	~TraceScope() {
+		if (name_) { Trace::end(name_); }
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define TRACE_SCOPE(name) TraceScope W2DIR_CONCAT(trace_scope_, __LINE__){ name }
+
+#endif